@@ -0,0 +1,74 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AdmissionController.h"
+
+AdmissionController::AdmissionController() {
+  for (int i = 0; i < MAXCLIENTS; i++) {
+    slotPrinters[i] = -1;
+    slotHeld[i] = false;
+  }
+}
+
+int AdmissionController::countSlots(int printerIndex) const {
+  int result = 0;
+  for (int i = 0; i < MAXCLIENTS; i++) {
+    if (slotPrinters[i] == printerIndex) {
+      result++;
+    }
+  }
+  return result;
+}
+
+bool AdmissionController::canAdmit(int printerIndex) const {
+  return countSlots(-1) > 0 && countSlots(printerIndex) < MAX_CLIENTS_PER_PRINTER && ESP.getFreeHeap() >= ADMISSION_MIN_FREE_HEAP;
+}
+
+int AdmissionController::acquire(int printerIndex) {
+  if (!canAdmit(printerIndex)) {
+    return -1;
+  }
+  for (int i = 0; i < MAXCLIENTS; i++) {
+    if (slotPrinters[i] == -1) {
+      slotPrinters[i] = printerIndex;
+      return i;
+    }
+  }
+  return -1;
+}
+
+void AdmissionController::release(int slot) {
+  slotPrinters[slot] = -1;
+  slotHeld[slot] = false;
+}
+
+void AdmissionController::setHeld(int slot, bool held) {
+  slotHeld[slot] = held;
+}
+
+bool AdmissionController::hasHeldSlot(int printerIndex) const {
+  for (int i = 0; i < MAXCLIENTS; i++) {
+    if (slotHeld[i] && slotPrinters[i] == printerIndex) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int AdmissionController::usedSlots() const {
+  return MAXCLIENTS - countSlots(-1);
+}
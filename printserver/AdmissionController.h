@@ -0,0 +1,41 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <Arduino.h>
+#include "Settings.h"
+
+// Hands out the client slots: MAXCLIENTS in all, at most MAX_CLIENTS_PER_PRINTER to one printer,
+// and none while the heap is below ADMISSION_MIN_FREE_HEAP. A job keeps its slot until it has
+// all of its data.
+class AdmissionController {
+  private:
+    int slotPrinters[MAXCLIENTS]; //-1 for a free slot
+    bool slotHeld[MAXCLIENTS]; //between the documents of a job
+
+    int countSlots(int printerIndex) const;
+  public:
+    AdmissionController();
+    bool canAdmit(int printerIndex) const;
+    // returns the slot, or -1 if the job can't be admitted now
+    int acquire(int printerIndex);
+    void release(int slot);
+    // a held slot waits for its job's next document (Send-Document) instead of receiving one
+    void setHeld(int slot, bool held);
+    bool hasHeldSlot(int printerIndex) const;
+    int usedSlots() const;
+};
@@ -0,0 +1,47 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BufferPool.h"
+
+byte BufferPool::slab[IO_BUFFER_COUNT][IO_BUFFER_SIZE];
+bool BufferPool::used[IO_BUFFER_COUNT];
+
+byte* BufferPool::acquire() {
+  for (int i = 0; i < IO_BUFFER_COUNT; i++) {
+    if (!used[i]) {
+      used[i] = true;
+      return slab[i];
+    }
+  }
+  return NULL;
+}
+
+void BufferPool::release(byte* buffer) {
+  if (buffer != NULL) {
+    used[(buffer - slab[0]) / IO_BUFFER_SIZE] = false;
+  }
+}
+
+int BufferPool::usedBuffers() {
+  int result = 0;
+  for (int i = 0; i < IO_BUFFER_COUNT; i++) {
+    if (used[i]) {
+      result++;
+    }
+  }
+  return result;
+}
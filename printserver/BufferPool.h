@@ -0,0 +1,33 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <Arduino.h>
+#include "Settings.h"
+
+// Fixed slab of I/O buffers, reserved at startup and lent to connections only while they
+// actually have data to send or received data waiting to be consumed
+class BufferPool {
+  private:
+    static byte slab[IO_BUFFER_COUNT][IO_BUFFER_SIZE];
+    static bool used[IO_BUFFER_COUNT];
+  public:
+    // returns NULL when every buffer is lent out
+    static byte* acquire();
+    static void release(byte* buffer);
+    static int usedBuffers();
+};
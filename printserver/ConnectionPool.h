@@ -0,0 +1,49 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+// Fixed set of connection objects created at startup; a connection goes back to the pool
+// as soon as close() is called on it
+template <class T, int N>
+class ConnectionPool {
+  private:
+    T connections[N];
+  public:
+    // returns NULL when every connection is in use
+    T* acquire(WiFiClient client) {
+      for (int i = 0; i < N; i++) {
+        if (!connections[i].isOpen()) {
+          connections[i].begin(client);
+          return &connections[i];
+        }
+      }
+      return NULL;
+    }
+
+    int inUse() {
+      int result = 0;
+      for (int i = 0; i < N; i++) {
+        if (connections[i].isOpen()) {
+          result++;
+        }
+      }
+      return result;
+    }
+};
@@ -17,94 +17,444 @@
 
 #include "HttpStream.h"
 
-HttpStream::HttpStream(WiFiClient conn): TcpStream(conn) {
+#define HEADER_CONTENT_LENGTH 0
+#define HEADER_TRANSFER_ENCODING 1
+#define HEADER_EXPECT 2
+#define HEADER_CONNECTION 3
+
+#define TOKEN_CHUNKED 0
+#define TOKEN_100_CONTINUE 1
+#define TOKEN_CLOSE 2
+#define TOKEN_KEEP_ALIVE 3
+
+#define ALL_CANDIDATES 0x0F
+
+// lowercase, matched case-insensitively one byte at a time as they arrive
+static const char* const knownHeaders[] = {"content-length", "transfer-encoding", "expect", "connection"};
+static const char* const knownTokens[] = {"chunked", "100-continue", "close", "keep-alive"};
+
+// drops the candidates that don't have c at the given position
+static void matchCandidates(const char* const* candidates, uint8_t& mask, int position, char c) {
+  c = tolower(c);
+  for (int i = 0; i < 4; i++) {
+    if ((mask & (1 << i)) && candidates[i][position] != c) { //a shorter candidate has '\0' there and is dropped too
+      mask &= ~(1 << i);
+    }
+  }
+}
+
+// the surviving candidate that is exactly length characters long, or -1
+static int8_t matchedCandidate(const char* const* candidates, uint8_t mask, int length) {
+  for (int i = 0; i < 4; i++) {
+    if ((mask & (1 << i)) && candidates[i][length] == '\0') {
+      return i;
+    }
+  }
+  return -1;
 }
 
-void HttpStream::parseNextChunkLength() {
-  String chunkLength = TcpStream::readStringUntil('\r');
-  TcpStream::read(); //consume '\n'
-  remainingChunkBytes = (int) strtol(chunkLength.c_str(), NULL, 16);
+void HttpStream::begin(WiFiClient conn) {
+  TcpStream::begin(conn);
+  resetRequest();
+}
+
+void HttpStream::resetRequest() {
+  headState = HEAD_METHOD;
+  chunkedResponse = false;
+  sendHeadroom = 0;
+  sendTailroom = 0;
+  requestMethod[0] = '\0';
+  requestPath[0] = '\0';
+  tokenLength = 0;
+  tokenMismatch = false;
+  requestHttp11 = false;
+  requestExpectContinue = false;
+  requestConnectionClose = false;
+  requestConnectionKeepAlive = false;
+  requestContentLength = 0;
+  requestContentLengthSeen = false;
+  requestChunkedEncoded = false;
+  remainingChunkBytes = 0;
+  chunkState = CHUNK_DONE;
+  chunkLineLength = 0;
+}
+
+// non-blocking: advances through chunk-size lines, chunk delimiters and the trailer until payload
+// bytes are next in the buffer or the buffered data runs out
+void HttpStream::parseChunkFraming() {
+  const byte* data;
+  size_t length;
+  while (chunkState != CHUNK_DATA && chunkState != CHUNK_DONE && chunkState != CHUNK_ERROR && (length = peekBuffered(&data)) > 0) {
+    size_t parsed = 0;
+    while (parsed < length && chunkState != CHUNK_DATA && chunkState != CHUNK_DONE) {
+      char c = data[parsed++];
+      switch (chunkState) {
+        case CHUNK_SIZE:
+        case CHUNK_EXTENSION:
+          if (c == '\n') {
+            chunkState = remainingChunkBytes > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+            chunkLineLength = 0;
+          } else if (chunkState == CHUNK_SIZE && isxdigit(c)) {
+            if (++chunkLineLength > HTTP_MAX_CHUNK_SIZE_DIGITS) {
+              Serial.println("Chunk too large, dropping the connection");
+              chunkState = CHUNK_ERROR;
+              failConnection();
+              return;
+            }
+            remainingChunkBytes = (remainingChunkBytes << 4) | (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+          } else if (c != '\r') {
+            chunkState = CHUNK_EXTENSION; //chunk extensions are ignored
+          }
+          break;
+
+        case CHUNK_DATA_END:
+          if (c == '\n') {
+            chunkState = CHUNK_SIZE;
+            remainingChunkBytes = 0;
+          }
+          break;
+
+        case CHUNK_TRAILER:
+          if (c == '\n') {
+            // the (usually empty) trailer ends with an empty line; then the connection is at the next request
+            chunkState = chunkLineLength == 0 ? CHUNK_DONE : CHUNK_TRAILER;
+            chunkLineLength = 0;
+          } else if (c != '\r') {
+            chunkLineLength++;
+          }
+          break;
+
+        default:
+          break;
+      }
+    }
+    consumeReceivedBytes(parsed);
+  }
 }
 
-byte HttpStream::read() {
-  byte result = TcpStream::read();
-  remainingChunkBytes--;
+size_t HttpStream::readBytes(byte* buffer, size_t length) {
+  if (requestChunkedEncoded) {
+    parseChunkFraming();
+    if (chunkState != CHUNK_DATA) {
+      return 0;
+    }
+  }
+  // a whole run of payload, never past the end of the current chunk (or past Content-Length)
+  size_t result = TcpStream::readBytes(buffer, min(length, (size_t) max(remainingChunkBytes, 0)));
+  remainingChunkBytes -= result;
   if (requestChunkedEncoded && remainingChunkBytes == 0) {
-    // consume CRLF chunk end delimiter
-    TcpStream::read();
-    TcpStream::read();
-    parseNextChunkLength();
+    chunkState = CHUNK_DATA_END;
+    parseChunkFraming();
   }
   return result;
 }
 
+size_t HttpStream::peekData(const byte** data) {
+  if (requestChunkedEncoded) {
+    parseChunkFraming();
+    if (chunkState != CHUNK_DATA) {
+      return 0;
+    }
+  }
+  return min(TcpStream::peekData(data), (size_t) max(remainingChunkBytes, 0));
+}
+
+void HttpStream::consumeData(size_t length) {
+  TcpStream::consumeData(length);
+  remainingChunkBytes -= length;
+  if (requestChunkedEncoded && remainingChunkBytes == 0) {
+    chunkState = CHUNK_DATA_END;
+    parseChunkFraming();
+  }
+}
+
 bool HttpStream::hasMoreData() {
-  return TcpStream::hasMoreData() && remainingChunkBytes != 0;
+  return TcpStream::hasMoreData() && !isRequestBodyConsumed();
 }
 
-bool HttpStream::parseRequestHeader() {
-  requestMethod = readStringUntil(' ');
-  if (requestMethod == "") {
-    return false;
+// only counts payload, not chunk framing that has arrived ahead of the data
+bool HttpStream::dataAvailable() {
+  if (requestChunkedEncoded) {
+    parseChunkFraming();
+    if (chunkState != CHUNK_DATA) {
+      return false;
+    }
   }
-  requestPath = readStringUntil(' ');
-  if (requestPath == "") {
-    return false;
+  return remainingChunkBytes > 0 && TcpStream::available() > 0;
+}
+
+void HttpStream::endHeaderValueToken() {
+  int8_t token = matchedCandidate(knownTokens, tokenCandidates, tokenLength);
+  if (currentHeader == HEADER_TRANSFER_ENCODING) {
+    requestChunkedEncoded = (token == TOKEN_CHUNKED); //chunked must be the last transfer coding
+  } else if (currentHeader == HEADER_EXPECT && token == TOKEN_100_CONTINUE) {
+    requestExpectContinue = true;
+  } else if (currentHeader == HEADER_CONNECTION && token == TOKEN_CLOSE) {
+    requestConnectionClose = true;
+  } else if (currentHeader == HEADER_CONNECTION && token == TOKEN_KEEP_ALIVE) {
+    requestConnectionKeepAlive = true;
   }
+  tokenLength = 0;
+  tokenCandidates = ALL_CANDIDATES;
+}
+
+// returns false on a malformed head
+bool HttpStream::parseHeadByte(char c) {
+  switch (headState) {
+    case HEAD_METHOD:
+      if (c == ' ' && tokenLength > 0) {
+        requestMethod[tokenLength] = '\0';
+        headState = HEAD_PATH;
+        tokenLength = 0;
+      } else if (c != ' ' && c != '\r' && c != '\n' && tokenLength < HTTP_MAX_METHOD_LENGTH) {
+        requestMethod[tokenLength++] = c;
+      } else {
+        return false;
+      }
+      return true;
+
+    case HEAD_PATH:
+      if (c == ' ' && tokenLength > 0) {
+        requestPath[tokenLength] = '\0';
+        headState = HEAD_VERSION;
+        tokenLength = 0;
+        tokenMismatch = false;
+      } else if (c != ' ' && c != '\r' && c != '\n' && tokenLength < HTTP_MAX_PATH_LENGTH) {
+        requestPath[tokenLength++] = c;
+      } else {
+        return false;
+      }
+      return true;
+
+    case HEAD_VERSION:
+      if (c == '\n') {
+        requestHttp11 = !tokenMismatch && tokenLength == (int) STRLEN(HTTP_11_VERSION);
+        headState = HEAD_HEADER_NAME;
+        tokenLength = 0;
+        tokenCandidates = ALL_CANDIDATES;
+      } else if (c != '\r') {
+        tokenMismatch |= tokenLength >= (int) STRLEN(HTTP_11_VERSION) || c != HTTP_11_VERSION[tokenLength];
+        tokenLength++;
+      }
+      return true;
+
+    case HEAD_HEADER_NAME:
+      if (c == '\n' && tokenLength == 0) {
+        headState = HEAD_DONE; //empty line: end of the head
+      } else if (c == ':') {
+        currentHeader = matchedCandidate(knownHeaders, tokenCandidates, tokenLength);
+        if (currentHeader == HEADER_CONTENT_LENGTH) {
+          if (requestContentLengthSeen) {
+            return false; //a repeated Content-Length may disagree with the first, so neither is trusted
+          }
+          requestContentLengthSeen = true;
+        }
+        headState = HEAD_HEADER_VALUE;
+        tokenLength = 0;
+        tokenMismatch = false;
+        tokenCandidates = ALL_CANDIDATES;
+      } else if (c == '\n') {
+        return false;
+      } else if (c != '\r') {
+        matchCandidates(knownHeaders, tokenCandidates, tokenLength, c);
+        tokenLength++;
+      }
+      return true;
+
+    case HEAD_HEADER_VALUE:
+      if (currentHeader == HEADER_CONTENT_LENGTH) {
+        // a single number, optionally surrounded by whitespace; tokenMismatch marks the end of the digits
+        if (c >= '0' && c <= '9') {
+          if (tokenMismatch || ++tokenLength > HTTP_MAX_CONTENT_LENGTH_DIGITS) {
+            return false;
+          }
+          requestContentLength = requestContentLength * 10 + (c - '0');
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+          tokenMismatch = tokenLength > 0;
+        } else if (c != '\n' || tokenLength == 0) {
+          return false;
+        }
+      } else if (currentHeader != -1 && (c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n')) {
+        if (tokenLength > 0) {
+          endHeaderValueToken();
+        }
+      } else if (currentHeader != -1) {
+        matchCandidates(knownTokens, tokenCandidates, tokenLength, c);
+        tokenLength++;
+      }
+      if (c == '\n') {
+        headState = HEAD_HEADER_NAME;
+        tokenLength = 0;
+        tokenCandidates = ALL_CANDIDATES;
+      }
+      return true;
 
-  readStringUntil('\r');
-  read(); //consume the '\n'
+    default:
+      return true;
+  }
+}
 
-  bool chunkedEncoded = false;
-  String header;
-  while ((header = readStringUntil('\r')) != "") {
-    header.toLowerCase(); //does not return a new string, modifies the existing one in-place (source: https://github.com/esp8266/Arduino/blob/master/cores/esp8266/WString.cpp#L732)
-    if (header.startsWith(CONTENT_LENGTH_HEADER)) {
-      requestContentLength = header.substring(STRLEN(CONTENT_LENGTH_HEADER)).toInt();
-      chunkedEncoded = false;
-      remainingChunkBytes = requestContentLength;
-    } else if (header == CHUNKED_ENCODING_HEADER) {
-      chunkedEncoded = true;
-      remainingChunkBytes = 0;
+int HttpStream::parseRequestHeader() {
+  if (headState == HEAD_DONE) {
+    return HTTP_HEAD_COMPLETE;
+  }
+  while (headState != HEAD_DONE) {
+    const byte* data;
+    size_t length = peekBuffered(&data);
+    if (length == 0) {
+      ready(1); //enforces the read deadline
+      return hasTimedOut() ? HTTP_HEAD_ERROR : HTTP_HEAD_INCOMPLETE;
     }
-    read(); //consume the '\n'
+    size_t parsed = 0;
+    while (parsed < length && headState != HEAD_DONE) {
+      if (!parseHeadByte((char) data[parsed++])) {
+        return HTTP_HEAD_ERROR;
+      }
+    }
+    consumeReceivedBytes(parsed);
   }
-  read(); //consume the '\n'
 
-  requestChunkedEncoded = chunkedEncoded;
-  if (chunkedEncoded) {
-    parseNextChunkLength();
+  if (requestChunkedEncoded) {
+    chunkState = CHUNK_SIZE;
+    remainingChunkBytes = 0;
+    parseChunkFraming();
+  } else {
+    remainingChunkBytes = requestContentLength;
   }
-  return true;
+  return HTTP_HEAD_COMPLETE;
 }
 
-std::map<String, String> HttpStream::parseUrlencodedRequestBody() {
-  std::map<String, String> result;
-  int parsedBytes = 0;
-  while (parsedBytes < requestContentLength) {
-    String key, value;
-    key.reserve(32);
-    value.reserve(32);
-    char readChar;
-    while (parsedBytes < requestContentLength && ((readChar = read()) != '=')) {
-      key += readChar;
-      parsedBytes++;
+int HttpStream::readRequestBody(char* buffer, size_t size, size_t& length) {
+  while (!isRequestBodyConsumed()) {
+    if (length + 1 >= size) {
+      return HTTP_HEAD_ERROR;
     }
-    parsedBytes++; // '='
-    while (parsedBytes < requestContentLength && ((readChar = read()) != '&')) {
-      value += readChar;
-      parsedBytes++;
+    size_t count = readBytes((byte*) buffer + length, size - 1 - length);
+    if (count == 0) {
+      ready(1); //enforces the read deadline
+      return hasTimedOut() || !connected() ? HTTP_HEAD_ERROR : HTTP_HEAD_INCOMPLETE;
     }
-    parsedBytes++; // '&'
-    result[key] = value;
+    length += count;
   }
-  return result;
+  buffer[length] = '\0';
+  return HTTP_HEAD_COMPLETE;
 }
 
-String HttpStream::getRequestMethod() {
+// the value of a field of an application/x-www-form-urlencoded body, "" if it's missing
+String HttpStream::getFormValue(const char* body, const char* name) {
+  size_t nameLength = strlen(name);
+  for (const char* field = body; *field != '\0'; field++) {
+    const char* end = strchr(field, '&');
+    if (end == NULL) {
+      end = field + strlen(field);
+    }
+    if (!strncmp(field, name, nameLength) && field[nameLength] == '=') {
+      String value;
+      value.concat(field + nameLength + 1, end - field - nameLength - 1);
+      return value;
+    }
+    if (*end == '\0') {
+      break;
+    }
+    field = end;
+  }
+  return "";
+}
+
+const char* HttpStream::getRequestMethod() {
   return requestMethod;
 }
 
-String HttpStream::getRequestPath() {
+const char* HttpStream::getRequestPath() {
   return requestPath;
 }
+
+bool HttpStream::isRequestBodyConsumed() {
+  if (requestChunkedEncoded) {
+    parseChunkFraming();
+    return chunkState == CHUNK_DONE;
+  }
+  return remainingChunkBytes <= 0;
+}
+
+bool HttpStream::expectsContinue() {
+  return requestExpectContinue && requestHttp11;
+}
+
+void HttpStream::sendContinueIfExpected() {
+  if (expectsContinue()) {
+    print(F("HTTP/1.1 100 Continue\r\n\r\n"));
+    flushSendBuffer();
+    requestExpectContinue = false; //only once, however often it's called
+  }
+}
+
+void HttpStream::beginResponse(const __FlashStringHelper* status, const __FlashStringHelper* contentType, bool keepAlive) {
+  print(F("HTTP/1.1 "));
+  print(status);
+  print(F("\r\nContent-Type: "));
+  print(contentType);
+  print(keepAlive ? F("\r\nTransfer-Encoding: chunked\r\n\r\n") : F("\r\nConnection: close\r\nTransfer-Encoding: chunked\r\n\r\n"));
+  if (sendBuffer != NULL && sendBufferIndex + CHUNK_HEADER_LENGTH + CHUNK_TAILROOM >= SEND_BUFFER_SIZE) {
+    flushSendBuffer();
+  }
+  chunkedResponse = true;
+  sendHeadroom = CHUNK_HEADER_LENGTH;
+  sendTailroom = CHUNK_TAILROOM;
+  if (sendBuffer != NULL) {
+    sendBufferIndex += CHUNK_HEADER_LENGTH; //the headers stay in front of the first chunk, in the same segment
+  }
+  chunkPayloadStart = sendBuffer != NULL ? sendBufferIndex : CHUNK_HEADER_LENGTH;
+}
+
+void HttpStream::endResponse() {
+  if (!chunkedResponse) {
+    return;
+  }
+  frameChunk();
+  chunkedResponse = false;
+  sendHeadroom = 0;
+  sendTailroom = 0;
+  print(F("0\r\n\r\n")); //fits in the tail room when a buffer is in use
+  TcpStream::flushSendBuffer();
+}
+
+void HttpStream::frameChunk() {
+  if (sendBuffer == NULL) {
+    return;
+  }
+  int payloadLength = sendBufferIndex - chunkPayloadStart;
+  if (payloadLength == 0) {
+    sendBufferIndex -= CHUNK_HEADER_LENGTH; //nothing to frame, give the reserved header space back
+  } else {
+    char header[CHUNK_HEADER_LENGTH + 1];
+    snprintf(header, sizeof(header), "%03X\r\n", payloadLength);
+    memcpy(sendBuffer + chunkPayloadStart - CHUNK_HEADER_LENGTH, header, CHUNK_HEADER_LENGTH);
+    sendBuffer[sendBufferIndex++] = '\r';
+    sendBuffer[sendBufferIndex++] = '\n';
+  }
+  chunkPayloadStart = CHUNK_HEADER_LENGTH;
+}
+
+void HttpStream::flushSendBuffer() {
+  if (chunkedResponse) {
+    frameChunk();
+  }
+  TcpStream::flushSendBuffer();
+}
+
+void HttpStream::writeUnbuffered(const byte* data, size_t length, bool inFlash) {
+  if (!chunkedResponse) {
+    TcpStream::writeUnbuffered(data, length, inFlash);
+    return;
+  }
+  char header[12];
+  int headerLength = snprintf(header, sizeof(header), "%X\r\n", (unsigned int) length);
+  TcpStream::writeUnbuffered((const byte*) header, headerLength, false);
+  TcpStream::writeUnbuffered(data, length, inFlash);
+  TcpStream::writeUnbuffered((const byte*) "\r\n", 2, false);
+}
+
+bool HttpStream::wantsKeepAlive() {
+  return requestHttp11 ? !requestConnectionClose : requestConnectionKeepAlive;
+}
@@ -18,32 +18,111 @@
 #pragma once
 #include <Arduino.h>
 #include <WiFiClient.h>
-#include <map>
 #include "Settings.h"
 #include "TcpStream.h"
 
 #define STRLEN(s) ((sizeof(s) / sizeof(s[0])) - 1)
 
-#define CONTENT_LENGTH_HEADER "content-length: "
-#define CHUNKED_ENCODING_HEADER "transfer-encoding: chunked"
+#define HTTP_11_VERSION "HTTP/1.1"
+#define HTTP_MAX_METHOD_LENGTH 7
+#define HTTP_MAX_PATH_LENGTH 63
+
+// "5B4\r\n": three hex digits cover any chunk that fits in a send buffer
+#define CHUNK_HEADER_LENGTH 5
+// room for the CRLF closing a chunk plus the last-chunk "0\r\n\r\n"
+#define CHUNK_TAILROOM 7
+// a request's chunk-size has at most this many hex digits (256 MB), so it can't overflow an int
+#define HTTP_MAX_CHUNK_SIZE_DIGITS 7
+// and a Content-Length at most this many decimal ones
+#define HTTP_MAX_CONTENT_LENGTH_DIGITS 9
+
+// return values of parseRequestHeader()
+#define HTTP_HEAD_ERROR -1
+#define HTTP_HEAD_INCOMPLETE 0
+#define HTTP_HEAD_COMPLETE 1
+
+typedef enum {
+  HEAD_METHOD,
+  HEAD_PATH,
+  HEAD_VERSION,
+  HEAD_HEADER_NAME,
+  HEAD_HEADER_VALUE,
+  HEAD_DONE
+} http_head_state;
+
+typedef enum {
+  CHUNK_SIZE,
+  CHUNK_EXTENSION,
+  CHUNK_DATA,
+  CHUNK_DATA_END,
+  CHUNK_TRAILER,
+  CHUNK_DONE,
+  CHUNK_ERROR //the connection has been dropped
+} http_chunk_state;
 
 class HttpStream: public TcpStream {
   private:
-    String requestMethod = "";
-    String requestPath = "";
+    // request head parser state; only the parts of the head we act on are kept
+    http_head_state headState;
+    char requestMethod[HTTP_MAX_METHOD_LENGTH + 1];
+    char requestPath[HTTP_MAX_PATH_LENGTH + 1];
+    int tokenLength;
+    bool tokenMismatch;
+    uint8_t tokenCandidates;
+    int8_t currentHeader;
+    bool requestHttp11;
+    bool requestExpectContinue;
+    bool requestConnectionClose;
+    bool requestConnectionKeepAlive;
+
     int requestContentLength = 0;
+    bool requestContentLengthSeen = false;
     bool requestChunkedEncoded = false;
+    // body decoder: payload bytes left in the current chunk (or up to Content-Length), and the
+    // chunked framing state; framing is consumed in place, as soon as it is buffered
     int remainingChunkBytes = 0;
+    http_chunk_state chunkState;
+    int chunkLineLength;
+
+    // response framing: while chunkedResponse is set every flush of the send buffer goes out as one chunk
+    bool chunkedResponse = false;
+    int chunkPayloadStart = 0;
 
-    void parseNextChunkLength();
+    bool parseHeadByte(char c);
+    void endHeaderValueToken();
+    void parseChunkFraming();
+    void frameChunk();
+  protected:
+    void writeUnbuffered(const byte* data, size_t length, bool inFlash);
   public:
-    HttpStream(WiFiClient conn);
+    void begin(WiFiClient conn);
 
-    byte read();
+    size_t readBytes(byte* buffer, size_t length);
+    size_t peekData(const byte** data);
+    void consumeData(size_t length);
     bool hasMoreData();
+    bool dataAvailable();
+
+    void resetRequest();
+    // Resumable: consumes whatever part of the request head is buffered and returns
+    // HTTP_HEAD_INCOMPLETE until the blank line ending it has been parsed. Once it's complete,
+    // further calls just return HTTP_HEAD_COMPLETE.
+    int parseRequestHeader();
+    // Resumable, like parseRequestHeader(): appends what is buffered of the request body to buffer
+    // (length bytes of it are there already), and returns HTTP_HEAD_COMPLETE once all of it is in,
+    // NUL-terminated. HTTP_HEAD_ERROR if it doesn't fit in size bytes or the connection failed.
+    int readRequestBody(char* buffer, size_t size, size_t& length);
+    static String getFormValue(const char* body, const char* name);
+    const char* getRequestMethod();
+    const char* getRequestPath();
+    bool wantsKeepAlive();
+    bool isRequestBodyConsumed();
 
-    bool parseRequestHeader();
-    std::map<String, String> parseUrlencodedRequestBody();
-    String getRequestMethod();
-    String getRequestPath();
+    // the client waits for 100 Continue before it sends the body
+    bool expectsContinue();
+    void sendContinueIfExpected();
+    // writes the status line and headers; the body that follows is sent with chunked framing until endResponse()
+    void beginResponse(const __FlashStringHelper* status, const __FlashStringHelper* contentType, bool keepAlive);
+    void endResponse();
+    void flushSendBuffer();
 };
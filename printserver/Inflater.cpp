@@ -0,0 +1,501 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Inflater.h"
+
+#define GZIP_FLAG_HEADER_CRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
+
+// RFC1951 section 3.2.5
+static const uint16_t lengthBase[29] PROGMEM = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const byte lengthExtraBits[29] PROGMEM = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t distanceBase[30] PROGMEM = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const byte distanceExtraBits[30] PROGMEM = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// section 3.2.7
+static const byte codeLengthOrder[19] PROGMEM = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+bool Inflater::windowInUse = false;
+
+bool Inflater::canAllocate() {
+  return windowInUse || ESP.getMaxFreeBlockSize() >= sizeof(InflaterMemory);
+}
+
+int Inflater::begin(compression_type compression) {
+  if (windowInUse) {
+    return INFLATE_BUSY;
+  }
+  memory = canAllocate() ? (InflaterMemory*) malloc(sizeof(InflaterMemory)) : NULL;
+  if (memory == NULL) {
+    return INFLATE_NO_MEMORY;
+  }
+  windowInUse = true;
+  this->compression = compression;
+  startStream();
+  bitBuffer = 0;
+  bitCount = 0;
+  inputStart = 0;
+  inputEnd = 0;
+  windowPosition = 0;
+  outputCount = 0;
+  pendingSymbol = -1;
+  return INFLATE_STARTED;
+}
+
+void Inflater::startStream() {
+  state = compression == COMPRESSION_GZIP ? INFLATE_GZIP_HEADER : INFLATE_ZLIB_HEADER;
+  remaining = 10; //fixed part of the gzip header
+  trailerLength = compression == COMPRESSION_GZIP ? 8 : 0;
+  finalBlock = false;
+}
+
+void Inflater::end() {
+  if (memory != NULL) {
+    free(memory);
+    memory = NULL;
+    windowInUse = false;
+  }
+}
+
+bool Inflater::isActive() {
+  return memory != NULL;
+}
+
+bool Inflater::hasFailed() {
+  return memory != NULL && state == INFLATE_FAILED;
+}
+
+size_t Inflater::inputRoom() {
+  if (memory == NULL) {
+    return 0;
+  } else if (state == INFLATE_FAILED) {
+    return INFLATE_INPUT_SIZE;
+  }
+  return INFLATE_INPUT_SIZE - (inputEnd - inputStart);
+}
+
+size_t Inflater::write(const byte* data, size_t length) {
+  if (memory == NULL) {
+    return 0;
+  } else if (state == INFLATE_FAILED) {
+    return length;
+  }
+  if (inputStart == inputEnd) {
+    inputStart = 0;
+    inputEnd = 0;
+  } else if (INFLATE_INPUT_SIZE - inputEnd < length && inputStart > 0) {
+    memmove(memory->input, memory->input + inputStart, inputEnd - inputStart);
+    inputEnd -= inputStart;
+    inputStart = 0;
+  }
+  size_t count = min(length, (size_t) (INFLATE_INPUT_SIZE - inputEnd));
+  memcpy(memory->input + inputEnd, data, count);
+  inputEnd += count;
+  return count;
+}
+
+// bits are taken least significant first, so whole input bytes are shifted in above the ones left
+bool Inflater::needBits(int count) {
+  while (bitCount < count) {
+    if (inputStart == inputEnd) {
+      return false;
+    }
+    bitBuffer |= (uint32_t) memory->input[inputStart++] << bitCount;
+    bitCount += 8;
+  }
+  return true;
+}
+
+uint32_t Inflater::takeBits(int count) {
+  uint32_t result = bitBuffer & ((1UL << count) - 1);
+  bitBuffer >>= count;
+  bitCount -= count;
+  return result;
+}
+
+// Huffman codes are packed starting with their most significant bit: the code is walked one bit
+// at a time, against the first code of each length. Nothing is consumed until a whole code is in.
+int Inflater::decodeSymbol(const uint16_t* count, const uint16_t* symbol) {
+  int code = 0;
+  int first = 0;
+  int symbolIndex = 0;
+  for (int length = 1; length <= 15; length++) {
+    if (!needBits(length)) {
+      return INFLATE_NEED_INPUT;
+    }
+    code |= (bitBuffer >> (length - 1)) & 1;
+    int lengthCount = count[length];
+    if (code - lengthCount < first) {
+      takeBits(length);
+      return symbol[symbolIndex + (code - first)];
+    }
+    symbolIndex += lengthCount;
+    first = (first + lengthCount) << 1;
+    code <<= 1;
+  }
+  return INFLATE_ERROR;
+}
+
+// canonical Huffman code from the code lengths (RFC1951 section 3.2.2); false if over-subscribed
+bool Inflater::buildCode(uint16_t* count, uint16_t* symbol, const byte* lengths, int n) {
+  uint16_t offsets[16];
+  memset(count, 0, 16 * sizeof(uint16_t));
+  for (int i = 0; i < n; i++) {
+    count[lengths[i]]++;
+  }
+  int left = 1;
+  for (int length = 1; length <= 15; length++) {
+    left = (left << 1) - count[length];
+    if (left < 0) {
+      return false;
+    }
+  }
+  offsets[1] = 0;
+  for (int length = 1; length < 15; length++) {
+    offsets[length + 1] = offsets[length] + count[length];
+  }
+  for (int i = 0; i < n; i++) {
+    if (lengths[i] != 0) {
+      symbol[offsets[lengths[i]]++] = i;
+    }
+  }
+  return true;
+}
+
+void Inflater::buildFixedCodes() {
+  byte* lengths = memory->lengths;
+  memset(lengths, 8, 144);
+  memset(lengths + 144, 9, 112);
+  memset(lengths + 256, 7, 24);
+  memset(lengths + 280, 8, 8);
+  buildCode(memory->lengthCount, memory->lengthSymbol, lengths, 288);
+  memset(lengths, 5, 30);
+  buildCode(memory->distanceCount, memory->distanceSymbol, lengths, 30);
+}
+
+// the optional gzip header fields come in the order of their flags
+void Inflater::nextGzipField() {
+  remaining = 0;
+  if (gzipFlags & GZIP_FLAG_EXTRA) {
+    gzipFlags &= ~GZIP_FLAG_EXTRA;
+    state = INFLATE_GZIP_EXTRA_LENGTH;
+    remaining = 2;
+  } else if (gzipFlags & GZIP_FLAG_NAME) {
+    gzipFlags &= ~GZIP_FLAG_NAME;
+    state = INFLATE_GZIP_NAME;
+  } else if (gzipFlags & GZIP_FLAG_COMMENT) {
+    gzipFlags &= ~GZIP_FLAG_COMMENT;
+    state = INFLATE_GZIP_COMMENT;
+  } else if (gzipFlags & GZIP_FLAG_HEADER_CRC) {
+    gzipFlags &= ~GZIP_FLAG_HEADER_CRC;
+    state = INFLATE_GZIP_HEADER_CRC;
+    remaining = 2;
+  } else {
+    state = INFLATE_BLOCK_HEADER;
+  }
+}
+
+int Inflater::fail() {
+  Serial.println("Warning: corrupt compressed data");
+  state = INFLATE_FAILED;
+  return INFLATE_ERROR;
+}
+
+int Inflater::output(byte b) {
+  memory->window[windowPosition] = b;
+  windowPosition = (windowPosition + 1) & (INFLATE_WINDOW_SIZE - 1);
+  if (outputCount < INFLATE_WINDOW_SIZE) {
+    outputCount++;
+  }
+  return b;
+}
+
+int Inflater::read() {
+  if (memory == NULL) {
+    return INFLATE_ERROR;
+  }
+  while (true) {
+    switch (state) {
+      case INFLATE_ZLIB_HEADER: {
+        // a zlib wrapper is told apart from raw deflate data by its header check
+        if (!needBits(16)) {
+          return INFLATE_NEED_INPUT;
+        }
+        byte method = bitBuffer & 0xFF;
+        byte flags = (bitBuffer >> 8) & 0xFF;
+        if ((method & 0x0F) == 8 && (method >> 4) <= 7 && !(flags & 0x20) && ((method << 8) | flags) % 31 == 0) {
+          takeBits(16);
+          trailerLength = 4;
+        }
+        state = INFLATE_BLOCK_HEADER;
+        break;
+      }
+
+      case INFLATE_GZIP_HEADER:
+        while (remaining > 0) {
+          if (!needBits(8)) {
+            return INFLATE_NEED_INPUT;
+          }
+          byte b = takeBits(8);
+          int position = 10 - remaining--;
+          if ((position == 0 && b != 0x1F) || (position == 1 && b != 0x8B) || (position == 2 && b != 8)) {
+            return fail();
+          } else if (position == 3) {
+            gzipFlags = b;
+          }
+        }
+        nextGzipField();
+        break;
+
+      case INFLATE_GZIP_EXTRA_LENGTH:
+        if (!needBits(16)) {
+          return INFLATE_NEED_INPUT;
+        }
+        remaining = takeBits(16);
+        state = INFLATE_GZIP_EXTRA;
+        break;
+
+      case INFLATE_GZIP_EXTRA:
+      case INFLATE_GZIP_HEADER_CRC:
+        while (remaining > 0) {
+          if (!needBits(8)) {
+            return INFLATE_NEED_INPUT;
+          }
+          takeBits(8);
+          remaining--;
+        }
+        nextGzipField();
+        break;
+
+      case INFLATE_GZIP_NAME:
+      case INFLATE_GZIP_COMMENT:
+        do {
+          if (!needBits(8)) {
+            return INFLATE_NEED_INPUT;
+          }
+        } while (takeBits(8) != 0);
+        nextGzipField();
+        break;
+
+      case INFLATE_BLOCK_HEADER:
+        if (!needBits(3)) {
+          return INFLATE_NEED_INPUT;
+        }
+        finalBlock = takeBits(1);
+        switch (takeBits(2)) {
+          case 0:
+            takeBits(bitCount & 7); //stored blocks start on a byte boundary
+            state = INFLATE_STORED_LENGTH;
+            break;
+          case 1:
+            buildFixedCodes();
+            state = INFLATE_LENGTH_CODE;
+            break;
+          case 2:
+            state = INFLATE_TABLE_COUNTS;
+            break;
+          default:
+            return fail();
+        }
+        break;
+
+      case INFLATE_STORED_LENGTH:
+        if (!needBits(32)) {
+          return INFLATE_NEED_INPUT;
+        }
+        remaining = takeBits(16);
+        if (takeBits(16) != (~remaining & 0xFFFF)) {
+          return fail();
+        }
+        state = INFLATE_STORED_DATA;
+        break;
+
+      case INFLATE_STORED_DATA:
+        if (remaining == 0) {
+          state = finalBlock ? INFLATE_TRAILER : INFLATE_BLOCK_HEADER;
+          break;
+        }
+        if (!needBits(8)) {
+          return INFLATE_NEED_INPUT;
+        }
+        remaining--;
+        return output(takeBits(8));
+
+      case INFLATE_TABLE_COUNTS:
+        if (!needBits(14)) {
+          return INFLATE_NEED_INPUT;
+        }
+        literalCodes = takeBits(5) + 257;
+        distanceCodes = takeBits(5) + 1;
+        codeLengthCodes = takeBits(4) + 4;
+        if (literalCodes > 286 || distanceCodes > 30) {
+          return fail();
+        }
+        memset(memory->lengths, 0, 19);
+        index = 0;
+        state = INFLATE_TABLE_CODE_LENGTHS;
+        break;
+
+      case INFLATE_TABLE_CODE_LENGTHS:
+        while (index < codeLengthCodes) {
+          if (!needBits(3)) {
+            return INFLATE_NEED_INPUT;
+          }
+          memory->lengths[pgm_read_byte(&codeLengthOrder[index++])] = takeBits(3);
+        }
+        if (!buildCode(memory->distanceCount, memory->distanceSymbol, memory->lengths, 19)) {
+          return fail();
+        }
+        index = 0;
+        pendingSymbol = -1;
+        state = INFLATE_TABLE_LENGTHS;
+        break;
+
+      case INFLATE_TABLE_LENGTHS:
+        while (index < literalCodes + distanceCodes) {
+          if (pendingSymbol == -1) {
+            pendingSymbol = decodeSymbol(memory->distanceCount, memory->distanceSymbol);
+            if (pendingSymbol == INFLATE_NEED_INPUT) {
+              pendingSymbol = -1;
+              return INFLATE_NEED_INPUT;
+            } else if (pendingSymbol < 0) {
+              return fail();
+            }
+          }
+          if (pendingSymbol < 16) {
+            memory->lengths[index++] = pendingSymbol;
+          } else {
+            // 16: repeat the previous length 3-6 times, 17: 3-10 zeroes, 18: 11-138 zeroes
+            int extraBits = pendingSymbol == 16 ? 2 : (pendingSymbol == 17 ? 3 : 7);
+            if (!needBits(extraBits)) {
+              return INFLATE_NEED_INPUT;
+            }
+            int repeat = takeBits(extraBits) + (pendingSymbol == 18 ? 11 : 3);
+            byte length = 0;
+            if (pendingSymbol == 16) {
+              if (index == 0) {
+                return fail();
+              }
+              length = memory->lengths[index - 1];
+            }
+            if (index + repeat > literalCodes + distanceCodes) {
+              return fail();
+            }
+            memset(memory->lengths + index, length, repeat);
+            index += repeat;
+          }
+          pendingSymbol = -1;
+        }
+        if (memory->lengths[256] == 0
+            || !buildCode(memory->lengthCount, memory->lengthSymbol, memory->lengths, literalCodes)
+            || !buildCode(memory->distanceCount, memory->distanceSymbol, memory->lengths + literalCodes, distanceCodes)) {
+          return fail();
+        }
+        state = INFLATE_LENGTH_CODE;
+        break;
+
+      case INFLATE_LENGTH_CODE: {
+        int decoded = decodeSymbol(memory->lengthCount, memory->lengthSymbol);
+        if (decoded == INFLATE_NEED_INPUT) {
+          return INFLATE_NEED_INPUT;
+        } else if (decoded < 0 || decoded > 285) {
+          return fail();
+        } else if (decoded < 256) {
+          return output(decoded);
+        } else if (decoded == 256) {
+          state = finalBlock ? INFLATE_TRAILER : INFLATE_BLOCK_HEADER;
+          break;
+        }
+        pendingSymbol = decoded - 257;
+        state = INFLATE_LENGTH_EXTRA;
+        break;
+      }
+
+      case INFLATE_LENGTH_EXTRA: {
+        int extraBits = pgm_read_byte(&lengthExtraBits[pendingSymbol]);
+        if (!needBits(extraBits)) {
+          return INFLATE_NEED_INPUT;
+        }
+        copyLength = pgm_read_word(&lengthBase[pendingSymbol]) + takeBits(extraBits);
+        state = INFLATE_DISTANCE_CODE;
+        break;
+      }
+
+      case INFLATE_DISTANCE_CODE: {
+        int decoded = decodeSymbol(memory->distanceCount, memory->distanceSymbol);
+        if (decoded == INFLATE_NEED_INPUT) {
+          return INFLATE_NEED_INPUT;
+        } else if (decoded < 0 || decoded > 29) {
+          return fail();
+        }
+        pendingSymbol = decoded;
+        state = INFLATE_DISTANCE_EXTRA;
+        break;
+      }
+
+      case INFLATE_DISTANCE_EXTRA: {
+        int extraBits = pgm_read_byte(&distanceExtraBits[pendingSymbol]);
+        if (!needBits(extraBits)) {
+          return INFLATE_NEED_INPUT;
+        }
+        copyDistance = pgm_read_word(&distanceBase[pendingSymbol]) + takeBits(extraBits);
+        pendingSymbol = -1;
+        if (copyDistance > outputCount) {
+          return fail();
+        }
+        state = INFLATE_COPY;
+        break;
+      }
+
+      case INFLATE_COPY:
+        if (copyLength == 0) {
+          state = INFLATE_LENGTH_CODE;
+          break;
+        }
+        copyLength--;
+        return output(memory->window[(windowPosition - copyDistance) & (INFLATE_WINDOW_SIZE - 1)]);
+
+      case INFLATE_TRAILER:
+        // the checksum isn't verified: TCP already protects the data on its way here
+        takeBits(bitCount & 7);
+        while (trailerLength > 0) {
+          if (!needBits(8)) {
+            return INFLATE_NEED_INPUT;
+          }
+          takeBits(8);
+          trailerLength--;
+        }
+        state = INFLATE_DONE;
+        break;
+
+      case INFLATE_DONE:
+        // anything after the end is the next stream; gzip files may end with padding, though
+        if (!needBits(8)) {
+          return INFLATE_END;
+        } else if (compression == COMPRESSION_GZIP && (bitBuffer & 0xFF) != 0x1F) {
+          takeBits(bitCount);
+          inputStart = inputEnd;
+          return INFLATE_END;
+        }
+        startStream();
+        break;
+
+      case INFLATE_FAILED:
+        return INFLATE_ERROR;
+    }
+  }
+}
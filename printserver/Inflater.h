@@ -0,0 +1,129 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <Arduino.h>
+
+// the window has to cover the largest distance a deflate stream may refer back to
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_INPUT_SIZE 256
+
+// read() results that aren't data
+#define INFLATE_NEED_INPUT -1
+#define INFLATE_END -2
+#define INFLATE_ERROR -3
+
+// begin() results
+#define INFLATE_NO_MEMORY -1
+#define INFLATE_BUSY 0
+#define INFLATE_STARTED 1
+
+typedef enum {
+  COMPRESSION_NONE,
+  COMPRESSION_DEFLATE, //raw (RFC1951), or with a zlib wrapper (RFC1950)
+  COMPRESSION_GZIP
+} compression_type;
+
+typedef enum {
+  INFLATE_ZLIB_HEADER,
+  INFLATE_GZIP_HEADER,
+  INFLATE_GZIP_EXTRA_LENGTH,
+  INFLATE_GZIP_EXTRA,
+  INFLATE_GZIP_NAME,
+  INFLATE_GZIP_COMMENT,
+  INFLATE_GZIP_HEADER_CRC,
+  INFLATE_BLOCK_HEADER,
+  INFLATE_STORED_LENGTH,
+  INFLATE_STORED_DATA,
+  INFLATE_TABLE_COUNTS,
+  INFLATE_TABLE_CODE_LENGTHS,
+  INFLATE_TABLE_LENGTHS,
+  INFLATE_LENGTH_CODE,
+  INFLATE_LENGTH_EXTRA,
+  INFLATE_DISTANCE_CODE,
+  INFLATE_DISTANCE_EXTRA,
+  INFLATE_COPY,
+  INFLATE_TRAILER,
+  INFLATE_DONE,
+  INFLATE_FAILED
+} inflate_state;
+
+// allocated by begin(), freed by end()
+struct InflaterMemory {
+  byte window[INFLATE_WINDOW_SIZE];
+  byte input[INFLATE_INPUT_SIZE];
+  byte lengths[288 + 32]; //code lengths of a dynamic block
+  // canonical Huffman codes: number of codes of each length, and the symbols ordered by code
+  uint16_t lengthCount[16];
+  uint16_t lengthSymbol[288];
+  uint16_t distanceCount[16];
+  uint16_t distanceSymbol[32]; //also holds the code length code while a dynamic block header is read
+};
+
+// Streaming deflate/gzip decoder: compressed data is pushed in with write() as it arrives, and the
+// output is pulled with read() as fast as the printer takes it. Either side can stall at any byte.
+// Streams that follow each other (gzip members, or the documents of a job) are decoded in turn.
+// Only one inflater can hold a window at a time, the heap couldn't fit two.
+class Inflater {
+  private:
+    static bool windowInUse;
+
+    InflaterMemory* memory = NULL;
+    compression_type compression;
+    inflate_state state;
+    bool finalBlock;
+    uint32_t bitBuffer;
+    int bitCount;
+    size_t inputStart;
+    size_t inputEnd;
+    uint16_t windowPosition;
+    uint32_t outputCount; //up to the window size: how far back references may go
+    int pendingSymbol; //decoded, waiting for its extra bits; -1 if none
+    int index;
+    uint32_t remaining; //bytes left in a header field, stored block or trailer
+    byte gzipFlags;
+    int trailerLength;
+    int literalCodes;
+    int distanceCodes;
+    int codeLengthCodes;
+    uint16_t copyLength;
+    uint16_t copyDistance;
+
+    bool needBits(int count);
+    uint32_t takeBits(int count);
+    int decodeSymbol(const uint16_t* count, const uint16_t* symbol);
+    bool buildCode(uint16_t* count, uint16_t* symbol, const byte* lengths, int n);
+    void buildFixedCodes();
+    void nextGzipField();
+    void startStream();
+    int fail();
+    int output(byte b);
+  public:
+    // whether begin() could have the window, now or once the other printer is done with it
+    static bool canAllocate();
+
+    // INFLATE_BUSY if the other printer has the window, INFLATE_NO_MEMORY if the heap can't fit it
+    int begin(compression_type compression);
+    void end();
+    bool isActive();
+    bool hasFailed();
+    // how much write() would take now
+    size_t inputRoom();
+    // after an error everything is accepted and dropped
+    size_t write(const byte* data, size_t length);
+    // the next output byte, or INFLATE_NEED_INPUT, INFLATE_END or INFLATE_ERROR
+    int read();
+};
@@ -0,0 +1,290 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Settings.h"
+#include "WiFiManager.h"
+#include "IppStream.h"
+#include "IppAttributeCache.h"
+
+typedef enum : byte {
+  SOURCE_TEXT, //the text of the table entry, with multiple values separated by commas
+  SOURCE_NUMBER, //the number of the table entry: 1 byte for booleans, 4 bytes otherwise
+  SOURCE_OPERATIONS,
+  SOURCE_PRINTER_NAME,
+  SOURCE_PRINTER_URI,
+  SOURCE_COMPRESSION, //the text of the table entry, all but the first value only if the inflater fits the heap
+  // patched before each response
+  SOURCE_PRINTER_STATE,
+  SOURCE_UP_TIME,
+  SOURCE_QUEUED_JOB_COUNT
+} attribute_source;
+
+#define GROUP_PRINTER_DESCRIPTION 0x01
+
+struct PrinterAttribute {
+  char name[40];
+  byte valueTag;
+  attribute_source source;
+  char text[20];
+  uint32_t number;
+  byte groups;
+};
+
+// Kept in flash, sorted by name. Adding an attribute only takes a line here.
+static constexpr PrinterAttribute printerAttributes[] PROGMEM = {
+  {"charset-configured", IPP_VALUE_TAG_CHARSET, SOURCE_TEXT, "utf-8", 0, GROUP_PRINTER_DESCRIPTION},
+  {"charset-supported", IPP_VALUE_TAG_CHARSET, SOURCE_TEXT, "utf-8", 0, GROUP_PRINTER_DESCRIPTION},
+  {"compression-supported", IPP_VALUE_TAG_KEYWORD, SOURCE_COMPRESSION, "none,deflate,gzip", 0, GROUP_PRINTER_DESCRIPTION},
+  {"document-format-default", IPP_VALUE_TAG_MIME_MEDIA_TYPE, SOURCE_TEXT, "text/plain", 0, GROUP_PRINTER_DESCRIPTION}, //TODO - get from printer?
+  {"document-format-supported", IPP_VALUE_TAG_MIME_MEDIA_TYPE, SOURCE_TEXT, "text/plain", 0, GROUP_PRINTER_DESCRIPTION}, //TODO - get from printer?
+  {"generated-natural-language-supported", IPP_VALUE_TAG_NATURAL_LANGUAGE, SOURCE_TEXT, "en-us", 0, GROUP_PRINTER_DESCRIPTION},
+  {"ipp-versions-supported", IPP_VALUE_TAG_KEYWORD, SOURCE_TEXT, "1.1", 0, GROUP_PRINTER_DESCRIPTION},
+  {"job-priority-default", IPP_VALUE_TAG_INTEGER, SOURCE_NUMBER, "", JOB_PRIORITY_DEFAULT, GROUP_PRINTER_DESCRIPTION},
+  {"job-priority-supported", IPP_VALUE_TAG_INTEGER, SOURCE_NUMBER, "", 100, GROUP_PRINTER_DESCRIPTION}, //as many levels as values
+  {"multiple-document-jobs-supported", IPP_VALUE_TAG_BOOLEAN, SOURCE_NUMBER, "", 1, GROUP_PRINTER_DESCRIPTION},
+  {"multiple-operation-time-out", IPP_VALUE_TAG_INTEGER, SOURCE_NUMBER, "", JOB_TIMEOUT_MS / 1000, GROUP_PRINTER_DESCRIPTION},
+  {"natural-language-configured", IPP_VALUE_TAG_NATURAL_LANGUAGE, SOURCE_TEXT, "en-us", 0, GROUP_PRINTER_DESCRIPTION},
+  {"operations-supported", IPP_VALUE_TAG_ENUM, SOURCE_OPERATIONS, "", 0, GROUP_PRINTER_DESCRIPTION},
+  {"pdl-override-supported", IPP_VALUE_TAG_KEYWORD, SOURCE_TEXT, "not-attempted", 0, GROUP_PRINTER_DESCRIPTION},
+  {"printer-is-accepting-jobs", IPP_VALUE_TAG_BOOLEAN, SOURCE_NUMBER, "", 1, GROUP_PRINTER_DESCRIPTION},
+  {"printer-name", IPP_VALUE_TAG_NAME, SOURCE_PRINTER_NAME, "", 0, GROUP_PRINTER_DESCRIPTION},
+  {"printer-state", IPP_VALUE_TAG_ENUM, SOURCE_PRINTER_STATE, "", 0, GROUP_PRINTER_DESCRIPTION},
+  {"printer-state-reasons", IPP_VALUE_TAG_KEYWORD, SOURCE_TEXT, "none", 0, GROUP_PRINTER_DESCRIPTION},
+  {"printer-up-time", IPP_VALUE_TAG_INTEGER, SOURCE_UP_TIME, "", 0, GROUP_PRINTER_DESCRIPTION},
+  {"printer-uri-supported", IPP_VALUE_TAG_URI, SOURCE_PRINTER_URI, "", 0, GROUP_PRINTER_DESCRIPTION},
+  {"queued-job-count", IPP_VALUE_TAG_INTEGER, SOURCE_QUEUED_JOB_COUNT, "", 0, GROUP_PRINTER_DESCRIPTION},
+  {"uri-authentication-supported", IPP_VALUE_TAG_KEYWORD, SOURCE_TEXT, "none", 0, GROUP_PRINTER_DESCRIPTION},
+  {"uri-security-supported", IPP_VALUE_TAG_KEYWORD, SOURCE_TEXT, "none", 0, GROUP_PRINTER_DESCRIPTION}
+};
+
+static constexpr int PRINTER_ATTRIBUTE_COUNT = sizeof(printerAttributes) / sizeof(printerAttributes[0]);
+static_assert(PRINTER_ATTRIBUTE_COUNT <= MAX_PRINTER_ATTRIBUTES, "too many printer attributes for the bitmasks");
+
+static constexpr int compareNames(const char* a, const char* b) {
+  return (*a != *b || *a == 0) ? *a - *b : compareNames(a + 1, b + 1);
+}
+
+static constexpr bool isSorted(int i) {
+  return i + 1 >= PRINTER_ATTRIBUTE_COUNT || (compareNames(printerAttributes[i].name, printerAttributes[i + 1].name) < 0 && isSorted(i + 1));
+}
+static_assert(isSorted(0), "printer attributes must be sorted by name");
+
+static constexpr uint32_t groupMask(byte group, int i) {
+  return i == PRINTER_ATTRIBUTE_COUNT ? 0 : (((printerAttributes[i].groups & group) ? (1UL << i) : 0) | groupMask(group, i + 1));
+}
+
+static constexpr uint32_t ALL_ATTRIBUTES = PRINTER_ATTRIBUTE_COUNT == 32 ? 0xFFFFFFFF : (1UL << PRINTER_ATTRIBUTE_COUNT) - 1;
+static constexpr uint32_t PRINTER_DESCRIPTION_ATTRIBUTES = groupMask(GROUP_PRINTER_DESCRIPTION, 0);
+
+static const uint16_t supportedOperations[] = {IPP_PRINT_JOB, IPP_VALIDATE_JOB, IPP_CREATE_JOB, IPP_SEND_DOCUMENT, IPP_CANCEL_JOB, IPP_GET_JOB_ATTRIBUTES, IPP_GET_JOBS, IPP_GET_PRINTER_ATTRIBUTES};
+
+uint32_t IppAttributeCache::findAttributes(const char* name) {
+  if (!strcmp(name, "all")) {
+    return ALL_ATTRIBUTES;
+  } else if (!strcmp(name, "printer-description")) {
+    return PRINTER_DESCRIPTION_ATTRIBUTES;
+  }
+  int low = 0;
+  int high = PRINTER_ATTRIBUTE_COUNT - 1;
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    int comparison = strcmp_P(name, printerAttributes[middle].name);
+    if (comparison == 0) {
+      return 1UL << middle;
+    } else if (comparison < 0) {
+      high = middle - 1;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return 0;
+}
+
+void IppAttributeCache::put(const byte* data, size_t length) {
+  if (!sizing && writeIndex + length <= IPP_ATTRIBUTES_SIZE) {
+    memcpy(blob + writeIndex, data, length);
+  }
+  writeIndex += length;
+}
+
+void IppAttributeCache::putAttributeHeader(byte valueTag, const char* name, uint16_t valueLength) {
+  uint16_t nameLength = strlen(name);
+  byte header[3] = {valueTag, (byte) (nameLength >> 8), (byte) (nameLength & 0xFF)};
+  byte lengthBytes[2] = {(byte) (valueLength >> 8), (byte) (valueLength & 0xFF)};
+  put(header, sizeof(header));
+  put((const byte*) name, nameLength);
+  put(lengthBytes, sizeof(lengthBytes));
+}
+
+void IppAttributeCache::putStringAttribute(byte valueTag, const char* name, const String& value) {
+  putAttributeHeader(valueTag, name, value.length());
+  put((const byte*) value.c_str(), value.length());
+}
+
+void IppAttributeCache::putByteAttribute(byte valueTag, const char* name, byte value) {
+  putAttributeHeader(valueTag, name, 1);
+  put(&value, 1);
+}
+
+uint16_t IppAttributeCache::put4BytesAttribute(byte valueTag, const char* name, uint32_t value) {
+  putAttributeHeader(valueTag, name, 4);
+  uint16_t valueOffset = writeIndex;
+  byte valueBytes[4] = {(byte) (value >> 24), (byte) (value >> 16), (byte) (value >> 8), (byte) value};
+  put(valueBytes, sizeof(valueBytes));
+  return valueOffset;
+}
+
+void IppAttributeCache::putAttribute(int index, Printer* printer) {
+  PrinterAttribute attribute;
+  memcpy_P(&attribute, &printerAttributes[index], sizeof(attribute));
+  const char* name = attribute.name;
+  switch (attribute.source) {
+    case SOURCE_COMPRESSION:
+      compressionIndex = index;
+      if (!Inflater::canAllocate()) {
+        putStringAttribute(attribute.valueTag, name, strtok(attribute.text, ","));
+        break;
+      }
+      //fall through
+    case SOURCE_TEXT: {
+      char* value = attribute.text;
+      for (char* separator = strchr(value, ','); separator != NULL; separator = strchr(value, ',')) {
+        *separator = '\0';
+        putStringAttribute(attribute.valueTag, name, value);
+        name = ""; //additional value
+        value = separator + 1;
+      }
+      putStringAttribute(attribute.valueTag, name, value);
+      break;
+    }
+    case SOURCE_NUMBER:
+      if (attribute.valueTag == IPP_VALUE_TAG_BOOLEAN) {
+        putByteAttribute(attribute.valueTag, name, attribute.number);
+      } else {
+        put4BytesAttribute(attribute.valueTag, name, attribute.number);
+      }
+      break;
+    case SOURCE_OPERATIONS:
+      for (unsigned int i = 0; i < sizeof(supportedOperations) / sizeof(supportedOperations[0]); i++) {
+        put4BytesAttribute(attribute.valueTag, i == 0 ? name : "", supportedOperations[i]);
+      }
+      break;
+    case SOURCE_PRINTER_NAME:
+      putStringAttribute(attribute.valueTag, name, printer->getName());
+      break;
+    case SOURCE_PRINTER_URI:
+      uriIndex = index;
+      putStringAttribute(attribute.valueTag, name, "ipp://" + WiFiManager::getIP() + ":" + String(IPP_SERVER_PORT) + "/" + printer->getName());
+      break;
+    case SOURCE_PRINTER_STATE:
+      stateOffset = put4BytesAttribute(attribute.valueTag, name, 0);
+      break;
+    case SOURCE_UP_TIME:
+      upTimeOffset = put4BytesAttribute(attribute.valueTag, name, 0);
+      break;
+    case SOURCE_QUEUED_JOB_COUNT:
+      queuedJobCountOffset = put4BytesAttribute(attribute.valueTag, name, 0);
+      break;
+  }
+}
+
+void IppAttributeCache::serialize(Printer* printer) {
+  writeIndex = 0;
+  for (int i = 0; i < PRINTER_ATTRIBUTE_COUNT; i++) {
+    attributeOffsets[i] = writeIndex;
+    putAttribute(i, printer);
+  }
+  attributeOffsets[PRINTER_ATTRIBUTE_COUNT] = writeIndex;
+  serialized = writeIndex <= IPP_ATTRIBUTES_SIZE;
+}
+
+// rewrites one attribute whose length can change, after moving the ones behind it to fit
+bool IppAttributeCache::replaceAttribute(int index, Printer* printer) {
+  uint16_t end = attributeOffsets[index + 1];
+  uint16_t blobEnd = attributeOffsets[PRINTER_ATTRIBUTE_COUNT];
+  sizing = true;
+  writeIndex = 0;
+  putAttribute(index, printer);
+  sizing = false;
+  int shift = (int) writeIndex - (end - attributeOffsets[index]);
+  if (blobEnd + shift > IPP_ATTRIBUTES_SIZE) {
+    return false;
+  }
+  memmove(blob + end + shift, blob + end, blobEnd - end);
+  for (int i = index + 1; i <= PRINTER_ATTRIBUTE_COUNT; i++) {
+    attributeOffsets[i] += shift;
+  }
+  uint16_t* valueOffsets[] = {&upTimeOffset, &stateOffset, &queuedJobCountOffset};
+  for (uint16_t* offset : valueOffsets) {
+    if (*offset >= end) {
+      *offset += shift;
+    }
+  }
+  writeIndex = attributeOffsets[index];
+  putAttribute(index, printer);
+  return true;
+}
+
+void IppAttributeCache::patch4Bytes(uint16_t offset, uint32_t value) {
+  blob[offset] = value >> 24;
+  blob[offset + 1] = value >> 16;
+  blob[offset + 2] = value >> 8;
+  blob[offset + 3] = value;
+}
+
+void IppAttributeCache::update(Printer* printer) {
+  uint32_t ip = WiFiManager::getIPAddress();
+  bool compression = Inflater::canAllocate();
+  if (!serialized) {
+    serialize(printer);
+  } else {
+    if (ip != cachedIP) {
+      serialized = replaceAttribute(uriIndex, printer);
+    }
+    if (compression != cachedCompression && serialized) {
+      serialized = replaceAttribute(compressionIndex, printer);
+    }
+  }
+  cachedIP = ip;
+  cachedCompression = compression;
+  if (!serialized) {
+    Serial.println("Warning: the attributes of " + printer->getName() + " don't fit IPP_ATTRIBUTES_SIZE");
+    return;
+  }
+  patch4Bytes(stateOffset, printer->getStatus() == IDLE ? 3 : 4); //3 = idle, 4 = processing
+  patch4Bytes(upTimeOffset, millis() / 1000);
+  patch4Bytes(queuedJobCountOffset, printer->getQueuedJobCount());
+}
+
+// contiguous runs of requested attributes go out as a single span
+void IppAttributeCache::writeAttributes(TcpStream& stream, uint32_t attributes) {
+  if (!serialized) {
+    return;
+  }
+  int i = 0;
+  while (i < PRINTER_ATTRIBUTE_COUNT) {
+    if (!(attributes & (1UL << i))) {
+      i++;
+      continue;
+    }
+    int start = i;
+    while (i < PRINTER_ATTRIBUTE_COUNT && (attributes & (1UL << i))) {
+      i++;
+    }
+    SendSpan span = {blob + attributeOffsets[start], (size_t) (attributeOffsets[i] - attributeOffsets[start]), false};
+    stream.writeSpans(&span, 1);
+  }
+}
@@ -0,0 +1,63 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <Arduino.h>
+#include "Settings.h"
+#include "TcpStream.h"
+#include "Printer.h"
+
+// requested attributes are handled as a bitmask of the attribute table
+#define MAX_PRINTER_ATTRIBUTES 32
+
+// The printer attributes of one printer, serialized once into a fixed-size blob that
+// Get-Printer-Attributes responses are sent from. The 4-byte values are patched in place before
+// each response; when the IP address or the compressions that can be inflated change, only the
+// attribute holding them is rewritten, and the attributes after it are moved.
+class IppAttributeCache {
+  private:
+    byte blob[IPP_ATTRIBUTES_SIZE];
+    bool serialized = false; //and it fits
+    size_t writeIndex = 0;
+    bool sizing = false; //only counting bytes
+    uint16_t attributeOffsets[MAX_PRINTER_ATTRIBUTES + 1];
+    // offsets of the 4-byte values that are patched before each response
+    uint16_t upTimeOffset = 0;
+    uint16_t stateOffset = 0;
+    uint16_t queuedJobCountOffset = 0;
+    // the attributes rewritten when their value changes
+    int8_t uriIndex = -1;
+    int8_t compressionIndex = -1;
+    uint32_t cachedIP = 0;
+    bool cachedCompression = false;
+
+    void put(const byte* data, size_t length);
+    void putAttributeHeader(byte valueTag, const char* name, uint16_t valueLength);
+    void putStringAttribute(byte valueTag, const char* name, const String& value);
+    void putByteAttribute(byte valueTag, const char* name, byte value);
+    uint16_t put4BytesAttribute(byte valueTag, const char* name, uint32_t value);
+    void putAttribute(int index, Printer* printer);
+    void serialize(Printer* printer);
+    bool replaceAttribute(int index, Printer* printer);
+    void patch4Bytes(uint16_t offset, uint32_t value);
+  public:
+    // the attributes selected by a requested-attributes value (an attribute or group name)
+    static uint32_t findAttributes(const char* name);
+
+    // serializes the blob on first use, brings the values that changed up to date
+    void update(Printer* printer);
+    void writeAttributes(TcpStream& stream, uint32_t attributes);
+};
@@ -19,58 +19,250 @@
 #include "WiFiManager.h"
 #include "IppStream.h"
 
-std::set<String> allPrinterDescriptionAttributes {
-  "charset-configured",
-  "charset-supported",
-  "compression-supported",
-  "document-format-default",
-  "document-format-supported",
-  "generated-natural-language-supported",
-  "ipp-versions-supported",
-  "natural-language-configured",
-  "operations-supported",
-  "pdl-override-supported",
-  "printer-name",
-  "printer-is-accepting-jobs",
-  "printer-state",
-  "printer-state-reasons",
-  "printer-up-time",
-  "printer-uri-supported",
-  "queued-job-count",
-  "uri-authentication-supported",
-  "uri-security-supported"
+// in the order of ipp_request_attribute
+static const char* const requestAttributeNames[] = {
+  "attributes-charset",
+  "attributes-natural-language",
+  "requested-attributes",
+  "document-format",
+  "job-name",
+  "copies",
+  "compression",
+  "job-id",
+  "job-uri",
+  "which-jobs",
+  "limit",
+  "last-document",
+  "job-priority"
 };
 
-IppStream::IppStream(WiFiClient conn): HttpStream(conn) {
-}
-
-std::map<String, std::set<String>> IppStream::parseRequestAttributes() {
-  std::map<String, std::set<String>> result;
-  byte tag = read();
-  if (tag == IPP_OPERATION_ATTRIBUTES_TAG) {
-    String name = "";
-    int index = 0;
-    while ((tag = read()) >= 0x10) { //if tag >= 0x10, then it's a value-tag
-      uint16_t nameLength = read2Bytes();
-      if (nameLength != 0) {
-        name = readString(nameLength);
-      } //otherwise, it's another value for the previous attribute
-      uint16_t valueLength = read2Bytes();
-      String value = readString(valueLength);
-      if ((index == 0 && name != "attributes-charset") || (index == 1 && name != "attributes-natural-language")) {
-        result.clear();
-        return result;
+void IppStream::begin(WiFiClient conn) {
+  HttpStream::begin(conn);
+  parseState = IPP_PARSE_START;
+}
+
+// target NULL drops the field's bytes, and so do the ones past the first kept
+void IppStream::beginField(ipp_parse_state state, byte* target, uint16_t length, uint16_t kept) {
+  parseState = state;
+  fieldTarget = target;
+  fieldLength = length;
+  fieldKept = target != NULL ? kept : 0;
+  fieldRead = 0;
+}
+
+void IppStream::beginField(ipp_parse_state state, byte* target, uint16_t length) {
+  beginField(state, target, length, length);
+}
+
+// true once the whole field is in; never waits for bytes that haven't arrived
+bool IppStream::readField() {
+  while (fieldRead < fieldLength) {
+    byte skipped[32];
+    size_t count;
+    if (fieldRead < fieldKept) {
+      count = readBytes(fieldTarget + fieldRead, fieldKept - fieldRead);
+    } else {
+      count = readBytes(skipped, min((size_t) (fieldLength - fieldRead), sizeof(skipped)));
+    }
+    if (count == 0) {
+      return false;
+    }
+    fieldRead += count;
+  }
+  return true;
+}
+
+ipp_request_attribute IppStream::findRequestAttribute() {
+  if (fieldTarget == NULL) { //longer than any keyword
+    return IPP_ATTRIBUTE_UNKNOWN;
+  }
+  field[fieldLength] = '\0';
+  for (int i = 0; i < IPP_ATTRIBUTE_UNKNOWN; i++) {
+    if (!strcmp((char*) field, requestAttributeNames[i])) {
+      return (ipp_request_attribute) i;
+    }
+  }
+  return IPP_ATTRIBUTE_UNKNOWN;
+}
+
+// where the current attribute's string is kept, NULL if it isn't a kept string
+const char** IppStream::keptString() {
+  switch (currentAttribute) {
+    case IPP_ATTRIBUTE_CHARSET:
+      return &requestAttributes.charset;
+    case IPP_ATTRIBUTE_NATURAL_LANGUAGE:
+      return &requestAttributes.naturalLanguage;
+    case IPP_ATTRIBUTE_DOCUMENT_FORMAT:
+      return &requestAttributes.documentFormat;
+    case IPP_ATTRIBUTE_JOB_NAME:
+      return &requestAttributes.jobName;
+    case IPP_ATTRIBUTE_COMPRESSION:
+      return &requestAttributes.compression;
+    case IPP_ATTRIBUTE_WHICH_JOBS:
+      return &requestAttributes.whichJobs;
+    case IPP_ATTRIBUTE_JOB_URI:
+      return &requestAttributes.jobUri;
+    default:
+      return NULL;
+  }
+}
+
+// Where a value goes while it's read: the first value of a kept string goes straight to the arena
+// (kept holds how much of it), numbers and keywords to the field buffer, and the rest nowhere.
+byte* IppStream::valueTarget(uint16_t length, uint16_t& kept) {
+  kept = length;
+  const char** string = keptString();
+  if (string != NULL) {
+    if (*string != NULL) {
+      return NULL; //an additional value
+    }
+    uint16_t limit = IPP_ATTRIBUTE_ARENA_SIZE;
+    if (currentAttribute == IPP_ATTRIBUTE_JOB_NAME || currentAttribute == IPP_ATTRIBUTE_JOB_URI) {
+      limit -= IPP_ATTRIBUTE_ARENA_RESERVE;
+    }
+    if (currentAttribute == IPP_ATTRIBUTE_JOB_NAME) {
+      kept = min(length, (uint16_t) JOB_NAME_LENGTH);
+    }
+    if (requestAttributes.arenaLength + kept >= limit) {
+      requestAttributes.valueTooLong = true;
+      return NULL;
+    }
+    return (byte*) requestAttributes.arena + requestAttributes.arenaLength;
+  }
+  switch (currentAttribute) {
+    case IPP_ATTRIBUTE_REQUESTED_ATTRIBUTES:
+      return length <= IPP_MAX_KEYWORD_LENGTH ? field : NULL;
+    case IPP_ATTRIBUTE_COPIES:
+    case IPP_ATTRIBUTE_JOB_ID:
+    case IPP_ATTRIBUTE_LIMIT:
+    case IPP_ATTRIBUTE_JOB_PRIORITY:
+      return length == 4 ? field : NULL;
+    case IPP_ATTRIBUTE_LAST_DOCUMENT:
+      return length == 1 ? field : NULL;
+    default:
+      return NULL;
+  }
+}
+
+// the value has been read into valueTarget()
+void IppStream::storeAttributeValue() {
+  const char** string = keptString();
+  if (string != NULL) {
+    if (fieldTarget != NULL) {
+      char* arenaString = requestAttributes.arena + requestAttributes.arenaLength;
+      arenaString[fieldKept] = '\0';
+      requestAttributes.arenaLength += fieldKept + 1;
+      *string = arenaString;
+      if (currentAttribute == IPP_ATTRIBUTE_JOB_URI && strrchr(arenaString, '/') != NULL) {
+        requestAttributes.jobId = strtoul(strrchr(arenaString, '/') + 1, NULL, 10);
       }
-      result[name].insert(value);
-      index++;
-      //Serial.printf("Parsed IPP attribute: tag=0x%02X, name=\"%s\", value=\"%s\"\r\n", tag, name.c_str(), value.c_str());
     }
+    return;
   }
-  return result;
+  uint32_t number = 0;
+  if (fieldTarget == field) {
+    field[fieldLength] = '\0';
+    number = ((uint32_t) field[0] << 24) | ((uint32_t) field[1] << 16) | ((uint32_t) field[2] << 8) | field[3];
+  }
+  switch (currentAttribute) {
+    case IPP_ATTRIBUTE_REQUESTED_ATTRIBUTES:
+      requestAttributes.hasRequestedAttributes = true;
+      if (fieldTarget != NULL) {
+        requestAttributes.requestedAttributes |= IppAttributeCache::findAttributes((char*) field);
+      }
+      break;
+    case IPP_ATTRIBUTE_COPIES:
+      if (fieldTarget != NULL) {
+        requestAttributes.copies = number;
+      }
+      break;
+    case IPP_ATTRIBUTE_JOB_ID:
+      if (fieldTarget != NULL) {
+        requestAttributes.jobId = number;
+      }
+      break;
+    case IPP_ATTRIBUTE_LIMIT:
+      if (fieldTarget != NULL) {
+        requestAttributes.limit = number;
+      }
+      break;
+    case IPP_ATTRIBUTE_JOB_PRIORITY:
+      if (fieldTarget != NULL) {
+        requestAttributes.jobPriority = number;
+      }
+      break;
+    case IPP_ATTRIBUTE_LAST_DOCUMENT:
+      if (fieldTarget != NULL) {
+        requestAttributes.lastDocument = field[0] != 0;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// Resumable: reads every attribute group up to the end-of-attributes tag, as far as the buffered
+// bytes go, so that the document data (if any) comes next. Returns HTTP_HEAD_INCOMPLETE until
+// then, and HTTP_HEAD_ERROR if the request is malformed.
+int IppStream::parseRequestAttributes() {
+  while (readField()) {
+    uint16_t length = (field[0] << 8) | field[1];
+    switch (parseState) {
+      case IPP_PARSE_FIRST_TAG:
+        if (field[0] != IPP_OPERATION_ATTRIBUTES_TAG) {
+          return HTTP_HEAD_ERROR;
+        }
+        beginField(IPP_PARSE_TAG, field, 1);
+        break;
+      case IPP_PARSE_TAG:
+        if (field[0] == IPP_END_OF_ATTRIBUTES_TAG) {
+          parseState = IPP_PARSE_DONE;
+          return requestAttributes.charset != NULL ? HTTP_HEAD_COMPLETE : HTTP_HEAD_ERROR;
+        } else if (field[0] == 0) { //reserved
+          return HTTP_HEAD_ERROR;
+        } else if (field[0] < 0x10) { //another delimiter tag: the next attribute group starts
+          beginField(IPP_PARSE_TAG, field, 1);
+        } else {
+          beginField(IPP_PARSE_NAME_LENGTH, field, 2);
+        }
+        break;
+      case IPP_PARSE_NAME_LENGTH:
+        if (length == 0) { //another value for the previous attribute
+          beginField(IPP_PARSE_VALUE_LENGTH, field, 2);
+        } else {
+          beginField(IPP_PARSE_NAME, length <= IPP_MAX_KEYWORD_LENGTH ? field : NULL, length);
+        }
+        break;
+      case IPP_PARSE_NAME:
+        currentAttribute = findRequestAttribute();
+        beginField(IPP_PARSE_VALUE_LENGTH, field, 2);
+        break;
+      case IPP_PARSE_VALUE_LENGTH: {
+        if ((attributeCount == 0 && currentAttribute != IPP_ATTRIBUTE_CHARSET) || (attributeCount == 1 && currentAttribute != IPP_ATTRIBUTE_NATURAL_LANGUAGE)) {
+          return HTTP_HEAD_ERROR;
+        }
+        uint16_t kept;
+        byte* target = valueTarget(length, kept);
+        beginField(IPP_PARSE_VALUE, target, length, kept);
+        break;
+      }
+      case IPP_PARSE_VALUE:
+        storeAttributeValue();
+        attributeCount++;
+        beginField(IPP_PARSE_TAG, field, 1);
+        break;
+      default:
+        return HTTP_HEAD_ERROR;
+    }
+  }
+  return hasMoreData() ? HTTP_HEAD_INCOMPLETE : HTTP_HEAD_ERROR;
 }
 
-void IppStream::beginResponse(uint16_t statusCode, uint32_t requestId, String charset) {
-  print("HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nContent-Type: application/ipp\r\n\r\n");
+// jobFollows: the document data of a Print-Job or Send-Document is still to be read, the connection
+// is closed after it
+void IppStream::beginIppResponse(uint16_t statusCode, uint32_t requestId, const char* charset, bool jobFollows) {
+  keepAlive = !jobFollows && wantsKeepAlive() && isRequestBodyConsumed();
+  beginResponse(F("200 OK"), F("application/ipp"), keepAlive);
   write2Bytes(IPP_SUPPORTED_VERSION);
   write2Bytes(statusCode);
   write4Bytes(requestId);
@@ -79,178 +271,354 @@ void IppStream::beginResponse(uint16_t statusCode, uint32_t requestId, String ch
   writeStringAttribute(IPP_VALUE_TAG_NATURAL_LANGUAGE, "attributes-natural-language", "en-us");
 }
 
-void IppStream::writeStringAttribute(byte valueTag, String name, String value) {
-  write(valueTag);
-  write2Bytes((uint16_t) name.length());
-  print(name);
-  write2Bytes((uint16_t) value.length());
+void IppStream::endIppResponse() {
+  write(IPP_END_OF_ATTRIBUTES_TAG);
+  endResponse();
+}
+
+bool IppStream::isKeepAlive() {
+  return keepAlive;
+}
+
+void IppStream::writeAttributeHeader(byte valueTag, const char* name, uint16_t valueLength) {
+  uint16_t nameLength = strlen(name);
+  byte header[3] = {valueTag, (byte) (nameLength >> 8), (byte) (nameLength & 0xFF)};
+  byte lengthBytes[2] = {(byte) (valueLength >> 8), (byte) (valueLength & 0xFF)};
+  SendSpan spans[] = {
+    {header, sizeof(header), false},
+    {(const byte*) name, nameLength, false},
+    {lengthBytes, sizeof(lengthBytes), false}
+  };
+  writeSpans(spans, 3);
+}
+
+void IppStream::writeStringAttribute(byte valueTag, const char* name, const char* value) {
+  uint16_t valueLength = strlen(value);
+  writeAttributeHeader(valueTag, name, valueLength);
+  write((const byte*) value, valueLength);
+}
+
+void IppStream::writeStringAttribute(byte valueTag, const char* name, const String& value) {
+  writeAttributeHeader(valueTag, name, value.length());
   print(value);
 }
 
-void IppStream::writeByteAttribute(byte valueTag, String name, byte value) {
-  write(valueTag);
-  write2Bytes((uint16_t) name.length());
-  print(name);
-  write2Bytes(1);
+void IppStream::writeByteAttribute(byte valueTag, const char* name, byte value) {
+  writeAttributeHeader(valueTag, name, 1);
   write(value);
 }
 
-void IppStream::write2BytesAttribute(byte valueTag, String name, uint16_t value) {
-  write(valueTag);
-  write2Bytes((uint16_t) name.length());
-  print(name);
-  write2Bytes(2);
+void IppStream::write2BytesAttribute(byte valueTag, const char* name, uint16_t value) {
+  writeAttributeHeader(valueTag, name, 2);
   write2Bytes(value);
 }
 
-void IppStream::write4BytesAttribute(byte valueTag, String name, uint32_t value) {
-  write(valueTag);
-  write2Bytes((uint16_t) name.length());
-  print(name);
-  write2Bytes(4);
+void IppStream::write4BytesAttribute(byte valueTag, const char* name, uint32_t value) {
+  writeAttributeHeader(valueTag, name, 4);
   write4Bytes(value);
 }
 
-void IppStream::writePrinterAttribute(String name, Printer* printer) {
-  if (name == "charset-configured") {
-    writeStringAttribute(IPP_VALUE_TAG_CHARSET, name, "utf-8");
-  } else if (name == "charset-supported") {
-    writeStringAttribute(IPP_VALUE_TAG_CHARSET, name, "utf-8");
-  } else if (name == "compression-supported") {
-    writeStringAttribute(IPP_VALUE_TAG_KEYWORD, name, "none");
-  } else if (name == "document-format-default") {
-    writeStringAttribute(IPP_VALUE_TAG_MIME_MEDIA_TYPE, name, "text/plain"); //TODO - get from printer?
-  } else if (name == "document-format-supported") {
-    writeStringAttribute(IPP_VALUE_TAG_MIME_MEDIA_TYPE, name, "text/plain"); //TODO - get from printer?
-  } else if (name == "generated-natural-language-supported") {
-    writeStringAttribute(IPP_VALUE_TAG_NATURAL_LANGUAGE, name, "en-us");
-  } else if (name =="ipp-versions-supported") {
-    writeStringAttribute(IPP_VALUE_TAG_KEYWORD, name, "1.1");
-  } else if (name == "natural-language-configured") {
-    writeStringAttribute(IPP_VALUE_TAG_NATURAL_LANGUAGE, name, "en-us");
-  } else if (name == "operations-supported") {
-    write4BytesAttribute(IPP_VALUE_TAG_ENUM, name, IPP_PRINT_JOB);
-    write4BytesAttribute(IPP_VALUE_TAG_ENUM, "", IPP_VALIDATE_JOB);
-    //write4BytesAttribute(IPP_VALUE_TAG_ENUM, "", IPP_CANCEL_JOB);
-    //write4BytesAttribute(IPP_VALUE_TAG_ENUM, "", IPP_GET_JOB_ATTRIBUTES);
-    //write4BytesAttribute(IPP_VALUE_TAG_ENUM, "", IPP_GET_JOBS);
-    write4BytesAttribute(IPP_VALUE_TAG_ENUM, "", IPP_GET_PRINTER_ATTRIBUTES);
-  } else if (name == "pdl-override-supported") {
-    writeStringAttribute(IPP_VALUE_TAG_KEYWORD, name, "not-attempted");
-  } else if (name == "printer-name") {
-    writeStringAttribute(IPP_VALUE_TAG_NAME, name, printer->getName());
-  } else if (name =="printer-is-accepting-jobs") {
-    writeByteAttribute(IPP_VALUE_TAG_BOOLEAN, name, 1);
-  } else if (name == "printer-state") {
-    write4BytesAttribute(IPP_VALUE_TAG_ENUM, name, 3); //3 = idle
-  } else if (name == "printer-state-reasons") {
-    writeStringAttribute(IPP_VALUE_TAG_KEYWORD, name, "none");
-  } else if (name == "printer-up-time") {
-    write4BytesAttribute(IPP_VALUE_TAG_INTEGER, name, millis() / 1000);
-  } else if (name == "printer-uri-supported") {
-    writeStringAttribute(IPP_VALUE_TAG_URI, name, "ipp://" + WiFiManager::getIP() + ":" + String(IPP_SERVER_PORT) + "/" + printer->getName());
-  } else if (name == "queued-job-count") {
-    write4BytesAttribute(IPP_VALUE_TAG_INTEGER, name, 0);
-  } else if (name == "uri-authentication-supported") {
-    writeStringAttribute(IPP_VALUE_TAG_KEYWORD, name, "none");
-  } else if (name == "uri-security-supported") {
-    writeStringAttribute(IPP_VALUE_TAG_KEYWORD, name, "none");
+void IppStream::handleGetPrinterAttributesRequest(IppAttributeCache& attributeCache, Printer* printer) {
+  uint32_t attributes = requestAttributes.requestedAttributes;
+  if (!requestAttributes.hasRequestedAttributes) {
+    attributes = IppAttributeCache::findAttributes("all");
   }
+
+  attributeCache.update(printer);
+  write(IPP_PRINTER_ATTRIBUTES_TAG);
+  attributeCache.writeAttributes(*this, attributes);
 }
 
-void IppStream::handleGetPrinterAttributesRequest(std::map<String, std::set<String>> requestAttributes, Printer* printer) {
-  std::set<String>& requestedAttributes = requestAttributes["requested-attributes"];
+String IppStream::getPrinterUri() {
+  return "ipp://" + WiFiManager::getIP() + ":" + String(IPP_SERVER_PORT) + "/" + targetPrinter->getName();
+}
 
-  if (requestedAttributes.size() == 0 || (requestedAttributes.find("all") != requestedAttributes.end()) || (requestedAttributes.find("printer-description") != requestedAttributes.end())) {
-    requestedAttributes = allPrinterDescriptionAttributes;
+// full: every job attribute, otherwise only job-id and job-uri (the Get-Jobs default)
+void IppStream::writeJobAttributes(Job* job, bool full) {
+  write(IPP_JOB_ATTRIBUTES_TAG);
+  write4BytesAttribute(IPP_VALUE_TAG_INTEGER, "job-id", job->id);
+  writeStringAttribute(IPP_VALUE_TAG_URI, "job-uri", getPrinterUri() + "/" + String(job->id));
+  if (!full) {
+    return;
+  }
+  writeStringAttribute(IPP_VALUE_TAG_URI, "job-printer-uri", getPrinterUri());
+  writeStringAttribute(IPP_VALUE_TAG_NAME, "job-name", job->name);
+  write4BytesAttribute(IPP_VALUE_TAG_INTEGER, "job-priority", job->priority);
+  write4BytesAttribute(IPP_VALUE_TAG_ENUM, "job-state", job->state);
+  const char* reason = "none";
+  if (job->state == JOB_PENDING && job->clientId != -1) {
+    reason = "job-incoming";
+  } else if (job->state == JOB_PROCESSING) {
+    reason = "job-printing";
+  } else if (job->state == JOB_CANCELED) {
+    reason = "job-canceled-by-user";
+  } else if (job->state == JOB_COMPLETED) {
+    reason = "job-completed-successfully";
+  } else if (job->state == JOB_ABORTED) {
+    reason = "aborted-by-system";
+  }
+  writeStringAttribute(IPP_VALUE_TAG_KEYWORD, "job-state-reasons", reason);
+  write4BytesAttribute(IPP_VALUE_TAG_INTEGER, "job-k-octets", (job->bytes + 1023) / 1024);
+  write4BytesAttribute(IPP_VALUE_TAG_INTEGER, "time-at-creation", job->createdAt / 1000);
+  if (job->isFinished()) {
+    write4BytesAttribute(IPP_VALUE_TAG_INTEGER, "time-at-completed", job->completedAt / 1000);
+  } else {
+    writeAttributeHeader(IPP_VALUE_TAG_NO_VALUE, "time-at-completed", 0);
   }
+}
 
-  write(IPP_PRINTER_ATTRIBUTES_TAG);
-  for (String attributeName: requestedAttributes) {
-    writePrinterAttribute(attributeName, printer);
+void IppStream::handleGetJobsRequest() {
+  bool completed = requestAttributes.whichJobs != NULL && !strcmp(requestAttributes.whichJobs, "completed");
+  beginIppResponse(IPP_SUCCESFUL_OK, requestId, requestAttributes.charset);
+  JobTable& jobs = targetPrinter->getJobs();
+  uint32_t count = 0;
+  for (Job* job = jobs.next(0); job != NULL; job = jobs.next(job->id)) {
+    if (job->isFinished() == completed && (requestAttributes.limit == 0 || count < requestAttributes.limit)) {
+      writeJobAttributes(job, requestAttributes.hasRequestedAttributes);
+      count++;
+    }
   }
+  endIppResponse();
+}
 
-  write(IPP_END_OF_ATTRIBUTES_TAG);
+void IppStream::handleGetJobAttributesRequest() {
+  Job* job = targetPrinter->getJobs().find(requestAttributes.jobId);
+  if (job == NULL) {
+    beginIppResponse(IPP_CLIENT_ERROR_NOT_FOUND, requestId, requestAttributes.charset);
+  } else {
+    beginIppResponse(IPP_SUCCESFUL_OK, requestId, requestAttributes.charset);
+    writeJobAttributes(job, true);
+  }
+  endIppResponse();
 }
 
-int IppStream::parseRequest(Printer** printers, int printerCount) {
-  if (!parseRequestHeader()) {
-    return -1;
+void IppStream::handleCancelJobRequest() {
+  uint16_t statusCode = IPP_SUCCESFUL_OK;
+  if (targetPrinter->getJobs().find(requestAttributes.jobId) == NULL) {
+    statusCode = IPP_CLIENT_ERROR_NOT_FOUND;
+  } else if (!targetPrinter->cancelJob(requestAttributes.jobId)) {
+    statusCode = IPP_CLIENT_ERROR_NOT_POSSIBLE; //already finished
   }
+  beginIppResponse(statusCode, requestId, requestAttributes.charset);
+  endIppResponse();
+}
 
-  if (getRequestMethod() != "POST") {
-    print("HTTP/1.1 405 Method Not Allowed\r\n");
-    return -1;
+uint16_t IppStream::getOperationId() {
+  return operationId;
+}
+
+const char* IppStream::getJobName() {
+  return requestAttributes.jobName;
+}
+
+// -1 for a compression that isn't supported, or can't be inflated with the heap left now
+int IppStream::parseCompression() {
+  const char* compression = requestAttributes.compression;
+  if (compression == NULL || !strcmp(compression, "none")) {
+    return COMPRESSION_NONE;
+  } else if (!Inflater::canAllocate()) {
+    return -1; //the heap couldn't fit the inflater to print it
+  } else if (!strcmp(compression, "deflate")) {
+    return COMPRESSION_DEFLATE;
+  } else if (!strcmp(compression, "gzip")) {
+    return COMPRESSION_GZIP;
   }
+  return -1;
+}
 
-  Printer* printer = NULL;
-  int printerIndex = -1;
-  for (int i = 0; i < printerCount; i++) {
-    if (("/" + printers[i]->getName()) == getRequestPath()) {
-      printer = printers[i];
-      printerIndex = i;
-      break;
-    }
+compression_type IppStream::getCompression() {
+  return (compression_type) parseCompression();
+}
+
+byte IppStream::getJobPriority() {
+  uint32_t priority = requestAttributes.jobPriority;
+  if (priority == 0) {
+    return JOB_PRIORITY_DEFAULT;
   }
+  return min(priority, (uint32_t) 100);
+}
 
-  if (printer == NULL) {
-    print("HTTP/1.1 404 Not Found\r\n");
-    return -1;
+uint32_t IppStream::getJobId() {
+  return requestAttributes.jobId;
+}
+
+bool IppStream::isLastDocument() {
+  return requestAttributes.lastDocument;
+}
+
+// a Create-Job carries no document
+void IppStream::sendJobResponse(uint32_t jobId) {
+  Job* job = targetPrinter->getJobs().find(jobId);
+  if (job == NULL) { //already gone from the job table
+    sendErrorResponse(IPP_CLIENT_ERROR_NOT_FOUND);
+    return;
   }
+  beginIppResponse(IPP_SUCCESFUL_OK, requestId, requestAttributes.charset, operationId != IPP_CREATE_JOB);
+  writeJobAttributes(job, true);
+  endIppResponse();
+}
 
-  uint16_t ippVersion = read2Bytes();
-  uint16_t operationId = read2Bytes();
-  uint32_t requestId = read4Bytes();
-  Serial.printf("Received IPP request; Version: 0x%04X, OperationId: 0x%04X, RequestId: 0x%08X\r\n", ippVersion, operationId, requestId);
+void IppStream::sendErrorResponse(uint16_t statusCode) {
+  beginIppResponse(statusCode, requestId, requestAttributes.charset, operationId != IPP_CREATE_JOB);
+  endIppResponse();
+}
 
-  if (ippVersion != IPP_SUPPORTED_VERSION) {
-    Serial.println("Unsupported IPP version");
-    beginResponse(IPP_SERVER_ERROR_VERSION_NOT_SUPPORTED, requestId, "utf-8");
-    write(IPP_END_OF_ATTRIBUTES_TAG);
-    return -1;
+int IppStream::parseRequest(const RequestRouter& printerRoutes, Printer** printers, IppAttributeCache* attributeCaches, const AdmissionController& admission) {
+  int result = advanceRequest(printerRoutes, printers, attributeCaches, admission);
+  if (result != IPP_REQUEST_INCOMPLETE) {
+    parseState = IPP_PARSE_START; //ready for the next request on a persistent connection
   }
+  return result;
+}
 
-  if (requestId == 0) { //request-id must not be 0 (RFC8011 Section 4.1.2)
-    beginResponse(IPP_CLIENT_ERROR_BAD_REQUEST, requestId, "utf-8");
-    write(IPP_END_OF_ATTRIBUTES_TAG);
-    return -1;
+int IppStream::advanceRequest(const RequestRouter& printerRoutes, Printer** printers, IppAttributeCache* attributeCaches, const AdmissionController& admission) {
+  if (parseState == IPP_PARSE_START) {
+    keepAlive = false;
+    if (strcmp(getRequestMethod(), "POST") != 0) {
+      print(F("HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"));
+      return -1;
+    }
+    targetPrinterIndex = printerRoutes.find(getRequestMethod(), getRequestPath());
+    if (targetPrinterIndex == -1) {
+      targetPrinter = NULL;
+      print(F("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"));
+      return -1;
+    }
+    targetPrinter = printers[targetPrinterIndex];
+    // A client waiting for 100 Continue has a document to send: if the printer can take neither a
+    // new job nor the next document of a held one, it's turned away before the upload. The
+    // operation isn't known yet, so the answer is HTTP's rather than IPP's.
+    bool busy = !admission.canAdmit(targetPrinterIndex) || !targetPrinter->canAcceptJob();
+    if (expectsContinue() && busy && !admission.hasHeldSlot(targetPrinterIndex)) {
+      Serial.println("No slot for a new job");
+      print(F("HTTP/1.1 503 Service Unavailable\r\nRetry-After: 10\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"));
+      return -1;
+    }
+    sendContinueIfExpected();
+    beginField(IPP_PARSE_HEADER, field, 8); //version-number, operation-id and request-id
   }
+  int printerIndex = targetPrinterIndex;
+  Printer* printer = targetPrinter;
+
+  if (parseState == IPP_PARSE_HEADER) {
+    if (!readField()) {
+      if (hasMoreData()) {
+        return IPP_REQUEST_INCOMPLETE;
+      }
+      beginIppResponse(IPP_CLIENT_ERROR_BAD_REQUEST, 0, "utf-8");
+      endIppResponse();
+      return -1;
+    }
+    uint16_t ippVersion = (field[0] << 8) | field[1];
+    operationId = (field[2] << 8) | field[3];
+    requestId = ((uint32_t) field[4] << 24) | ((uint32_t) field[5] << 16) | ((uint32_t) field[6] << 8) | field[7];
+    Serial.printf("Received IPP request; Version: 0x%04X, OperationId: 0x%04X, RequestId: 0x%08X\r\n", ippVersion, operationId, requestId);
+
+    if (ippVersion != IPP_SUPPORTED_VERSION) {
+      Serial.println("Unsupported IPP version");
+      beginIppResponse(IPP_SERVER_ERROR_VERSION_NOT_SUPPORTED, requestId, "utf-8");
+      endIppResponse();
+      return -1;
+    }
+
+    if (requestId == 0) { //request-id must not be 0 (RFC8011 Section 4.1.2)
+      beginIppResponse(IPP_CLIENT_ERROR_BAD_REQUEST, requestId, "utf-8");
+      endIppResponse();
+      return -1;
+    }
+
+    if ((operationId == IPP_PRINT_JOB || operationId == IPP_CREATE_JOB) && (!admission.canAdmit(printerIndex) || !printer->canAcceptJob())) {
+      Serial.println("No slot for a new job");
+      beginIppResponse(IPP_SERVER_ERROR_BUSY, requestId, "utf-8", true);
+      endIppResponse();
+      return -1;
+    }
 
-  std::map<String, std::set<String>> requestAttributes = parseRequestAttributes();
+    memset(&requestAttributes, 0, sizeof(requestAttributes));
+    requestAttributes.copies = 1;
+    currentAttribute = IPP_ATTRIBUTE_UNKNOWN;
+    attributeCount = 0;
+    beginField(IPP_PARSE_FIRST_TAG, field, 1);
+  }
 
-  if (requestAttributes.size() == 0) {
-    beginResponse(IPP_CLIENT_ERROR_BAD_REQUEST, requestId, "utf-8");
-    write(IPP_END_OF_ATTRIBUTES_TAG);
+  int attributesStatus = parseRequestAttributes();
+  if (attributesStatus == HTTP_HEAD_INCOMPLETE) {
+    return IPP_REQUEST_INCOMPLETE;
+  } else if (attributesStatus == HTTP_HEAD_ERROR) {
+    beginIppResponse(IPP_CLIENT_ERROR_BAD_REQUEST, requestId, "utf-8");
+    endIppResponse();
+    return -1;
+  } else if (requestAttributes.valueTooLong) {
+    Serial.println("Request attributes too long");
+    sendErrorResponse(IPP_CLIENT_ERROR_REQUEST_VALUE_TOO_LONG);
     return -1;
   }
 
   switch (operationId) {
     case IPP_GET_PRINTER_ATTRIBUTES:
       Serial.println("Operation is Get-printer-Attributes");
-      beginResponse(IPP_SUCCESFUL_OK, requestId, *requestAttributes["attributes-charset"].begin());
-      handleGetPrinterAttributesRequest(requestAttributes, printer);
+      beginIppResponse(IPP_SUCCESFUL_OK, requestId, requestAttributes.charset);
+      handleGetPrinterAttributesRequest(attributeCaches[printerIndex], printer);
+      endIppResponse();
       return -1;
 
     case IPP_PRINT_JOB:
       Serial.println("Operation is Print-Job");
-      beginResponse(IPP_SUCCESFUL_OK, requestId, *requestAttributes["attributes-charset"].begin());
-      write(IPP_JOB_ATTRIBUTES_TAG);
-      write4BytesAttribute(IPP_VALUE_TAG_ENUM, "job-state", 5); //5 = processing
-      writeStringAttribute(IPP_VALUE_TAG_KEYWORD, "job-state-reasons", "none");
-      write(IPP_END_OF_ATTRIBUTES_TAG);
-      flushSendBuffer();
+      if (parseCompression() == -1) {
+        beginIppResponse(IPP_CLIENT_ERROR_COMPRESSION_NOT_SUPPORTED, requestId, requestAttributes.charset, true);
+        endIppResponse();
+        return -1;
+      }
+      return printerIndex;
+
+    case IPP_CREATE_JOB:
+      Serial.println("Operation is Create-Job");
+      return printerIndex;
+
+    case IPP_SEND_DOCUMENT: {
+      Serial.println("Operation is Send-Document");
+      // the documents of a job go to the client slot the job holds, which only the server knows
+      Job* job = printer->getJobs().find(requestAttributes.jobId);
+      uint16_t statusCode = IPP_SUCCESFUL_OK;
+      if (job == NULL) {
+        statusCode = IPP_CLIENT_ERROR_NOT_FOUND;
+      } else if (job->clientId == -1 || job->cancelRequested) {
+        statusCode = IPP_CLIENT_ERROR_NOT_POSSIBLE; //all its documents are in, or it's finished
+      } else if (parseCompression() == -1) {
+        statusCode = IPP_CLIENT_ERROR_COMPRESSION_NOT_SUPPORTED;
+      }
+      if (statusCode != IPP_SUCCESFUL_OK) {
+        sendErrorResponse(statusCode);
+        return -1;
+      }
       return printerIndex;
+    }
+
+    case IPP_GET_JOBS:
+      Serial.println("Operation is Get-Jobs");
+      handleGetJobsRequest();
+      return -1;
+
+    case IPP_GET_JOB_ATTRIBUTES:
+      Serial.println("Operation is Get-Job-Attributes");
+      handleGetJobAttributesRequest();
+      return -1;
+
+    case IPP_CANCEL_JOB:
+      Serial.println("Operation is Cancel-Job");
+      handleCancelJobRequest();
+      return -1;
 
     case IPP_VALIDATE_JOB:
       Serial.println("Operation is Validate-Job");
-      beginResponse(IPP_SUCCESFUL_OK, requestId, *requestAttributes["attributes-charset"].begin());
-      write(IPP_END_OF_ATTRIBUTES_TAG);
+      beginIppResponse(parseCompression() == -1 ? IPP_CLIENT_ERROR_COMPRESSION_NOT_SUPPORTED : IPP_SUCCESFUL_OK, requestId, requestAttributes.charset);
+      endIppResponse();
       return -1;
 
     default:
       Serial.println("The requested operation is not supported!");
-      beginResponse(IPP_SERVER_ERROR_OPERATION_NOT_SUPPORTED, requestId, "utf-8");
-      write(IPP_END_OF_ATTRIBUTES_TAG);
+      beginIppResponse(IPP_SERVER_ERROR_OPERATION_NOT_SUPPORTED, requestId, "utf-8");
+      endIppResponse();
       return -1;
   }
 }
@@ -18,17 +18,23 @@
 #pragma once
 #include <Arduino.h>
 #include <WiFiClient.h>
-#include <map>
-#include <set>
 #include "HttpStream.h"
 #include "Printer.h"
+#include "IppAttributeCache.h"
+#include "RequestRouter.h"
+#include "AdmissionController.h"
 
 #define IPP_SUPPORTED_VERSION 0x0101
 
 #define IPP_SUCCESFUL_OK 0x0000
 #define IPP_CLIENT_ERROR_BAD_REQUEST 0x0400
+#define IPP_CLIENT_ERROR_NOT_FOUND 0x0406
+#define IPP_CLIENT_ERROR_REQUEST_VALUE_TOO_LONG 0x0409
+#define IPP_CLIENT_ERROR_NOT_POSSIBLE 0x040C
+#define IPP_CLIENT_ERROR_COMPRESSION_NOT_SUPPORTED 0x040F
 #define IPP_SERVER_ERROR_OPERATION_NOT_SUPPORTED 0x0501
 #define IPP_SERVER_ERROR_VERSION_NOT_SUPPORTED 0x0503
+#define IPP_SERVER_ERROR_BUSY 0x0507
 
 #define IPP_OPERATION_ATTRIBUTES_TAG 0x01
 #define IPP_JOB_ATTRIBUTES_TAG 0x02
@@ -37,6 +43,7 @@
 #define IPP_UNSUPPORTED_ATTRIBUTES_TAG 0x05
 
 #define IPP_VALUE_TAG_UNSUPPORTED 0x10
+#define IPP_VALUE_TAG_NO_VALUE 0x13
 #define IPP_VALUE_TAG_INTEGER 0x21
 #define IPP_VALUE_TAG_BOOLEAN 0x22
 #define IPP_VALUE_TAG_ENUM 0x23
@@ -48,27 +55,146 @@
 #define IPP_VALUE_TAG_NATURAL_LANGUAGE 0x48
 #define IPP_VALUE_TAG_MIME_MEDIA_TYPE 0x49
 
+// Request attribute values are kept in a fixed arena. job-name is cut to JOB_NAME_LENGTH, and it
+// and job-uri leave IPP_ATTRIBUTE_ARENA_RESERVE bytes to the keywords that decide how a request is
+// handled; a kept value that still doesn't fit fails the request. Names longer than a keyword are
+// never acted upon.
+#define IPP_ATTRIBUTE_ARENA_SIZE 160
+#define IPP_ATTRIBUTE_ARENA_RESERVE 64
+#define IPP_MAX_KEYWORD_LENGTH 39
+
+// returned by parseRequest() while the request hasn't fully arrived
+#define IPP_REQUEST_INCOMPLETE -2
+
 #define IPP_PRINT_JOB 0x0002
 #define IPP_VALIDATE_JOB 0x0004
+#define IPP_CREATE_JOB 0x0005
+#define IPP_SEND_DOCUMENT 0x0006
 #define IPP_CANCEL_JOB 0x0008
 #define IPP_GET_JOB_ATTRIBUTES 0x0009
 #define IPP_GET_JOBS 0x000A
 #define IPP_GET_PRINTER_ATTRIBUTES 0x000B
 
+typedef enum {
+  IPP_ATTRIBUTE_CHARSET,
+  IPP_ATTRIBUTE_NATURAL_LANGUAGE,
+  IPP_ATTRIBUTE_REQUESTED_ATTRIBUTES,
+  IPP_ATTRIBUTE_DOCUMENT_FORMAT,
+  IPP_ATTRIBUTE_JOB_NAME,
+  IPP_ATTRIBUTE_COPIES,
+  IPP_ATTRIBUTE_COMPRESSION,
+  IPP_ATTRIBUTE_JOB_ID,
+  IPP_ATTRIBUTE_JOB_URI,
+  IPP_ATTRIBUTE_WHICH_JOBS,
+  IPP_ATTRIBUTE_LIMIT,
+  IPP_ATTRIBUTE_LAST_DOCUMENT,
+  IPP_ATTRIBUTE_JOB_PRIORITY,
+  IPP_ATTRIBUTE_UNKNOWN
+} ipp_request_attribute;
+
+// request parser states, from the end of the HTTP head to the end-of-attributes tag
+typedef enum {
+  IPP_PARSE_START,
+  IPP_PARSE_HEADER,
+  IPP_PARSE_FIRST_TAG,
+  IPP_PARSE_TAG,
+  IPP_PARSE_NAME_LENGTH,
+  IPP_PARSE_NAME,
+  IPP_PARSE_VALUE_LENGTH,
+  IPP_PARSE_VALUE,
+  IPP_PARSE_DONE
+} ipp_parse_state;
+
+// The request attributes the server acts upon; every other attribute is skipped while reading.
+// Strings point into the arena, and are NULL when the attribute is missing; only the first value
+// of each is kept.
+struct IppRequestAttributes {
+  char arena[IPP_ATTRIBUTE_ARENA_SIZE];
+  uint16_t arenaLength;
+  bool valueTooLong; //a kept string didn't fit the arena
+  const char* charset;
+  const char* naturalLanguage;
+  const char* documentFormat;
+  const char* jobName;
+  const char* compression;
+  const char* whichJobs;
+  const char* jobUri;
+  bool hasRequestedAttributes;
+  uint32_t requestedAttributes; //bitmask of the printer attribute table
+  uint32_t copies;
+  uint32_t jobPriority; //0 if missing
+  uint32_t jobId; //0 if missing; also taken from job-uri
+  uint32_t limit; //0 if missing
+  bool lastDocument;
+};
+
 class IppStream: public HttpStream {
   private:
-    std::map<String, std::set<String>> parseRequestAttributes();
-    void beginResponse(uint16_t statusCode, uint32_t requestId, String charset);
+    bool keepAlive = false;
+    uint32_t requestId = 0;
+    uint16_t operationId = 0;
+    Printer* targetPrinter = NULL;
+    int targetPrinterIndex = -1;
+    IppRequestAttributes requestAttributes;
+
+    // The parser reads one field (a tag, a length, a name or a value) at a time, into fieldTarget,
+    // as far as the buffered bytes go; short fields are kept in field, others in the arena.
+    ipp_parse_state parseState = IPP_PARSE_START;
+    byte field[IPP_MAX_KEYWORD_LENGTH + 1];
+    byte* fieldTarget;
+    uint16_t fieldLength;
+    uint16_t fieldKept; //the bytes of the field stored at fieldTarget, the rest is dropped
+    uint16_t fieldRead;
+    ipp_request_attribute currentAttribute;
+    int attributeCount;
+
+    void beginField(ipp_parse_state state, byte* target, uint16_t length, uint16_t kept);
+    void beginField(ipp_parse_state state, byte* target, uint16_t length);
+    bool readField();
+    ipp_request_attribute findRequestAttribute();
+    const char** keptString();
+    byte* valueTarget(uint16_t length, uint16_t& kept);
+    void storeAttributeValue();
+    int parseRequestAttributes();
+    int advanceRequest(const RequestRouter& printerRoutes, Printer** printers, IppAttributeCache* attributeCaches, const AdmissionController& admission);
+    void beginIppResponse(uint16_t statusCode, uint32_t requestId, const char* charset, bool jobFollows = false);
+    void endIppResponse();
+
+    void writeAttributeHeader(byte valueTag, const char* name, uint16_t valueLength);
+    void writeStringAttribute(byte valueTag, const char* name, const char* value);
+    void writeStringAttribute(byte valueTag, const char* name, const String& value);
+    void writeByteAttribute(byte valueTag, const char* name, byte value);
+    void write2BytesAttribute(byte valueTag, const char* name, uint16_t value);
+    void write4BytesAttribute(byte valueTag, const char* name, uint32_t value);
 
-    void writeStringAttribute(byte valueTag, String name, String value);
-    void writeByteAttribute(byte valueTag, String name, byte value);
-    void write2BytesAttribute(byte valueTag, String name, uint16_t value);
-    void write4BytesAttribute(byte valueTag, String name, uint32_t value);
+    void handleGetPrinterAttributesRequest(IppAttributeCache& attributeCache, Printer* printer);
 
-    void writePrinterAttribute(String name, Printer* printer);
-    void handleGetPrinterAttributesRequest(std::map<String, std::set<String>> requestAttributes, Printer* printer);
+    String getPrinterUri();
+    void writeJobAttributes(Job* job, bool full);
+    void handleGetJobsRequest();
+    void handleGetJobAttributesRequest();
+    void handleCancelJobRequest();
+    int parseCompression();
 
   public:
-    IppStream(WiFiClient conn);
-    int parseRequest(Printer** printers, int printerCount);
+    void begin(WiFiClient conn);
+    // To be called once parseRequestHeader() has completed, on every pass until it returns
+    // something else than IPP_REQUEST_INCOMPLETE: it never waits for bytes that haven't arrived.
+    // For a Print-Job, Create-Job or Send-Document, returns the index of the printer and leaves
+    // the response to sendJobResponse() or sendErrorResponse(); otherwise -1, once it's answered.
+    // The printers are routed by name, as "POST /<name>". A job that wouldn't be admitted gets
+    // server-error-busy before the rest of the request is read.
+    int parseRequest(const RequestRouter& printerRoutes, Printer** printers, IppAttributeCache* attributeCaches, const AdmissionController& admission);
+    uint16_t getOperationId();
+    const char* getJobName();
+    compression_type getCompression();
+    // job-priority, 1 to 100: JOB_PRIORITY_DEFAULT when it's missing
+    byte getJobPriority();
+    // the job a Send-Document is for
+    uint32_t getJobId();
+    bool isLastDocument();
+    void sendJobResponse(uint32_t jobId);
+    void sendErrorResponse(uint16_t statusCode);
+    // after a request that didn't start a job: whether the connection can carry the next request
+    bool isKeepAlive();
 };
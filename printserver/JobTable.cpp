@@ -0,0 +1,112 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "JobTable.h"
+
+bool Job::isFinished() {
+  return state >= JOB_CANCELED;
+}
+
+JobTable::JobTable() {
+  for (int i = 0; i < JOB_TABLE_SIZE; i++) {
+    jobs[i].id = 0;
+  }
+  for (int i = JOB_CANCELED; i <= JOB_COMPLETED; i++) {
+    finishedCounts[i - JOB_CANCELED] = 0;
+  }
+}
+
+Job* JobTable::add(int clientId, int spoolIndex, const char* name, byte priority) {
+  Job* job = NULL;
+  for (int i = 0; i < JOB_TABLE_SIZE; i++) {
+    Job* candidate = &jobs[i];
+    if (candidate->id == 0) {
+      job = candidate;
+      break;
+    }
+    if (candidate->isFinished() && (job == NULL || candidate->id < job->id)) {
+      job = candidate;
+    }
+  }
+  if (job == NULL) {
+    return NULL;
+  }
+  job->id = nextJobId++;
+  job->state = JOB_PENDING;
+  job->clientId = clientId;
+  job->spoolIndex = spoolIndex;
+  job->bytes = 0;
+  job->priority = priority;
+  job->createdAt = millis();
+  job->completedAt = 0;
+  job->cancelRequested = false;
+  strncpy(job->name, name != NULL ? name : "", JOB_NAME_LENGTH);
+  job->name[JOB_NAME_LENGTH] = '\0';
+  return job;
+}
+
+bool JobTable::hasRoom() {
+  for (int i = 0; i < JOB_TABLE_SIZE; i++) {
+    if (jobs[i].id == 0 || jobs[i].isFinished()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Job* JobTable::find(uint32_t id) {
+  for (int i = 0; i < JOB_TABLE_SIZE; i++) {
+    if (id != 0 && jobs[i].id == id) {
+      return &jobs[i];
+    }
+  }
+  return NULL;
+}
+
+Job* JobTable::findSpooled(int spoolIndex) {
+  for (int i = 0; i < JOB_TABLE_SIZE; i++) {
+    if (jobs[i].id != 0 && spoolIndex != -1 && jobs[i].spoolIndex == spoolIndex && !jobs[i].isFinished()) {
+      return &jobs[i];
+    }
+  }
+  return NULL;
+}
+
+Job* JobTable::next(uint32_t afterId) {
+  Job* result = NULL;
+  for (int i = 0; i < JOB_TABLE_SIZE; i++) {
+    if (jobs[i].id > afterId && (result == NULL || jobs[i].id < result->id)) {
+      result = &jobs[i];
+    }
+  }
+  return result;
+}
+
+void JobTable::finish(Job* job, job_state state) {
+  if (job != NULL && !job->isFinished()) {
+    job->state = state;
+    job->completedAt = millis();
+    finishedCounts[state - JOB_CANCELED]++;
+  }
+}
+
+uint32_t JobTable::getAddedCount() {
+  return nextJobId - 1;
+}
+
+uint32_t JobTable::getFinishedCount(job_state state) {
+  return finishedCounts[state - JOB_CANCELED];
+}
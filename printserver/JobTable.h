@@ -0,0 +1,66 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <Arduino.h>
+#include "Settings.h"
+
+// the values are the IPP job-state enums
+typedef enum {
+  JOB_PENDING = 3,
+  JOB_PROCESSING = 5,
+  JOB_CANCELED = 7,
+  JOB_ABORTED = 8,
+  JOB_COMPLETED = 9
+} job_state;
+
+struct Job {
+  uint32_t id; //0 for an unused entry
+  job_state state;
+  int clientId; //the client slot the documents are received on, -1 once they're all in
+  int spoolIndex; //-1 for a job printed directly, or one without a document yet
+  uint32_t bytes;
+  byte priority; //IPP job-priority, 1 to 100
+  unsigned long createdAt; //millis()
+  unsigned long completedAt;
+  bool cancelRequested; //to be acted upon by the server, for a job still being received
+  char name[JOB_NAME_LENGTH + 1];
+
+  bool isFinished();
+};
+
+// The recent jobs of a printer, held in a fixed array. When it's full, the oldest finished job
+// makes room for the new one: a job that's still waiting, being received or printed is never
+// dropped, so a printer takes no new job while all of them are.
+class JobTable {
+  private:
+    Job jobs[JOB_TABLE_SIZE];
+    uint32_t nextJobId = 1;
+    // jobs that ended canceled, aborted and completed, since startup
+    uint32_t finishedCounts[JOB_COMPLETED - JOB_CANCELED + 1];
+  public:
+    JobTable();
+    // NULL if every job is unfinished: see hasRoom()
+    Job* add(int clientId, int spoolIndex, const char* name, byte priority = JOB_PRIORITY_DEFAULT);
+    bool hasRoom();
+    Job* find(uint32_t id);
+    Job* findSpooled(int spoolIndex);
+    // the job with the lowest id above afterId, to walk the table in order
+    Job* next(uint32_t afterId);
+    void finish(Job* job, job_state state);
+    uint32_t getAddedCount();
+    uint32_t getFinishedCount(job_state state);
+};
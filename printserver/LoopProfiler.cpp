@@ -0,0 +1,82 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LoopProfiler.h"
+
+#if LOOP_PROFILER_ENABLED
+static const char* phaseNames[PHASE_COUNT] = {"loop", "clients", "housekeeping", "newSocketClients", "newIppClients", "pendingIppClients", "newWebClients", "processQueue", "debug"};
+
+uint32_t LoopProfiler::buckets[PHASE_COUNT][LOOP_PROFILER_BUCKETS];
+uint32_t LoopProfiler::counts[PHASE_COUNT];
+uint32_t LoopProfiler::maxCycles[PHASE_COUNT];
+uint32_t LoopProfiler::overheadCycles = 0;
+
+void LoopProfiler::record(loop_phase phase, uint32_t cycles) {
+  // the bucket is the number of significant bits above the first bucket's
+  int bucket = 32 - __builtin_clz(cycles | 1) - LOOP_PROFILER_FIRST_BUCKET_BITS;
+  bucket = constrain(bucket, 0, LOOP_PROFILER_BUCKETS - 1);
+  buckets[phase][bucket]++;
+  counts[phase]++;
+  if (cycles > maxCycles[phase]) {
+    maxCycles[phase] = cycles;
+  }
+}
+
+// the upper bound of the bucket the percentile falls in, or the maximum if that's lower
+uint32_t LoopProfiler::percentileCycles(loop_phase phase, int percent) {
+  uint32_t rank = (uint32_t) ((uint64_t) counts[phase] * percent / 100);
+  uint32_t seen = 0;
+  for (int i = 0; i < LOOP_PROFILER_BUCKETS - 1; i++) {
+    seen += buckets[phase][i];
+    if (seen > rank) {
+      return min((uint32_t) 1 << (LOOP_PROFILER_FIRST_BUCKET_BITS + i), maxCycles[phase]);
+    }
+  }
+  return maxCycles[phase];
+}
+
+void LoopProfiler::calibrate() {
+  const int rounds = 100;
+  uint32_t startCycles = ESP.getCycleCount();
+  for (int i = 0; i < rounds; i++) {
+    end(PHASE_DEBUG, start());
+  }
+  overheadCycles = (ESP.getCycleCount() - startCycles) / rounds;
+  counts[PHASE_DEBUG] = 0;
+  maxCycles[PHASE_DEBUG] = 0;
+  for (int i = 0; i < LOOP_PROFILER_BUCKETS; i++) {
+    buckets[PHASE_DEBUG][i] = 0;
+  }
+}
+
+bool LoopProfiler::formatReportLine(int index, char* line, size_t size) {
+  uint32_t mhz = ESP.getCpuFreqMHz();
+  if (index == 0) {
+    snprintf(line, size, "%-18s %10s %9s %9s %9s %9s\n", "phase (us)", "count", "p50", "p90", "p99", "max");
+  } else if (index <= PHASE_COUNT) {
+    loop_phase phase = (loop_phase) (index - 1);
+    snprintf(line, size, "%-18s %10lu %9lu %9lu %9lu %9lu\n", phaseNames[phase], (unsigned long) counts[phase],
+             (unsigned long) (percentileCycles(phase, 50) / mhz), (unsigned long) (percentileCycles(phase, 90) / mhz),
+             (unsigned long) (percentileCycles(phase, 99) / mhz), (unsigned long) (maxCycles[phase] / mhz));
+  } else if (index == PHASE_COUNT + 1) {
+    snprintf(line, size, "profiler overhead: %lu cycles per measured phase\n", (unsigned long) overheadCycles);
+  } else {
+    return false;
+  }
+  return true;
+}
+#endif
@@ -0,0 +1,81 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <Arduino.h>
+#include "Settings.h"
+
+typedef enum {
+  PHASE_LOOP,
+  PHASE_CLIENTS,
+  PHASE_HOUSEKEEPING,
+  PHASE_NEW_SOCKET_CLIENTS,
+  PHASE_NEW_IPP_CLIENTS,
+  PHASE_PENDING_IPP_CLIENTS,
+  PHASE_NEW_WEB_CLIENTS,
+  PHASE_QUEUE,
+  PHASE_DEBUG,
+  PHASE_COUNT
+} loop_phase;
+
+// durations from 2^(LOOP_PROFILER_FIRST_BUCKET_BITS + i - 1) up to 2^(LOOP_PROFILER_FIRST_BUCKET_BITS + i)
+// CPU cycles land in bucket i: at 80 MHz, bucket 0 holds everything below 3.2 us, the last one
+// everything above 3.4 s
+#define LOOP_PROFILER_BUCKETS 22
+#define LOOP_PROFILER_FIRST_BUCKET_BITS 8
+
+// Times the phases of loop() with the CPU cycle counter, into a histogram per phase. Measuring a
+// phase is two reads of the cycle counter and a few increments: calibrate() measures what it
+// costs, which the report shows. With LOOP_PROFILER_ENABLED set to 0 none of it is compiled in.
+#if LOOP_PROFILER_ENABLED
+class LoopProfiler {
+  private:
+    static uint32_t buckets[PHASE_COUNT][LOOP_PROFILER_BUCKETS];
+    static uint32_t counts[PHASE_COUNT];
+    static uint32_t maxCycles[PHASE_COUNT];
+    static uint32_t overheadCycles;
+
+    static void record(loop_phase phase, uint32_t cycles);
+    static uint32_t percentileCycles(loop_phase phase, int percent);
+  public:
+    static inline uint32_t start() {
+      return ESP.getCycleCount();
+    }
+    static inline void end(loop_phase phase, uint32_t startCycles) {
+      record(phase, ESP.getCycleCount() - startCycles);
+    }
+    // measures start() and end() themselves, to be called once at startup
+    static void calibrate();
+    // a header, one line per phase and one on the profiler's own cost; false past the last line. The
+    // percentiles are the upper bounds of their buckets.
+    static bool formatReportLine(int index, char* line, size_t size);
+};
+#else
+class LoopProfiler {
+  public:
+    static inline uint32_t start() {
+      return 0;
+    }
+    static inline void end(loop_phase, uint32_t) {
+    }
+    static inline void calibrate() {
+    }
+    static inline bool formatReportLine(int, char*, size_t) {
+      return false;
+    }
+};
+#endif
@@ -37,6 +37,20 @@ void ParallelPortPrinter::printByte(byte b) {
     Serial.println("Printer busy!");
     delay(100);
   }
+  strobeByte(b);
+}
+
+// strobes out bytes until the printer signals busy, or for PARALLEL_WRITE_TIME_US at most
+size_t ParallelPortPrinter::write(const byte* data, size_t length) {
+  unsigned long start = micros();
+  size_t count = 0;
+  while (count < length && canPrint() && micros() - start < PARALLEL_WRITE_TIME_US) {
+    strobeByte(data[count++]);
+  }
+  return count;
+}
+
+void ParallelPortPrinter::strobeByte(byte b) {
   setDataBus(b);
   digitalWrite(strobePin, LOW);
   delayMicroseconds(STROBE_DELAY);
@@ -22,10 +22,12 @@ class ParallelPortPrinter: public Printer {
   private:
     int strobePin;
     int busyPin;
+    void strobeByte(byte b);
   protected:
     ParallelPortPrinter(String _printerId, int _strobePin, int _busyPin);
     bool canPrint();
     void printByte(byte b);
+    size_t write(const byte* data, size_t length);
     virtual void setDataBus(byte b) = 0;
   public:
     String getInfo();
@@ -17,6 +17,14 @@
 
 #include "PrintQueue.h"
 
+// spooling stops with this much flash left
+#define FLASH_SPACE_MARGIN 4096
+// A spool file starts with the format, the compression and the priority. Older firmware started
+// it with the compression alone (0 to 2), then with the compression and the priority: their files
+// are dropped at startup.
+#define SPOOL_FORMAT 0xA3
+#define SPOOL_HEADER_SIZE 3
+
 size_t PrintQueue::availableFlashSpace = 0;
 
 void PrintQueue::updateAvailableFlashSpace() {
@@ -31,13 +39,14 @@ PrintQueue::PrintQueue(String _printerId) {
 
 void PrintQueue::init() {
   loadInfo();
+  loadSpooledJobs();
   updateAvailableFlashSpace();
+  ramBuffer = new byte[SPOOL_RAM_SIZE];
 }
 
 void PrintQueue::saveInfo() {
   File infoFile = SPIFFS.open(printerId, "w");
   infoFile.write(head);
-  infoFile.write(tail);
   infoFile.close();
 }
 
@@ -45,22 +54,126 @@ void PrintQueue::loadInfo() {
   if (SPIFFS.exists(printerId)) {
     File infoFile = SPIFFS.open(printerId, "r");
     head = infoFile.read();
-    tail = infoFile.read();
     infoFile.close();
   } else {
     head = 0;
-    tail = 0;
   }
 }
 
-void PrintQueue::startJob(int clientId) {
+// Indexes the complete spool files of the flash, left from before a restart or from an overflow
+// of the index, and the job in the RAM spool. The files are named after the printer and their
+// spool index.
+void PrintQueue::loadSpooledJobs() {
+  spooledJobsOverflowed = false;
+  Dir dir = SPIFFS.openDir(printerId);
+  while (dir.next()) {
+    String fName = dir.fileName();
+    if (!fName.endsWith("OK") || dir.fileSize() < SPOOL_HEADER_SIZE) {
+      continue;
+    }
+    String number = fName.substring(printerId.length(), fName.length() - 2);
+    int index = number.toInt();
+    if (index > 255 || String(index) != number) { //another printer's, whose id starts with this one's
+      continue;
+    }
+    File file = dir.openFile("r");
+    int format = file.read();
+    file.read(); //the compression
+    int priority = file.read();
+    file.close();
+    if (format != SPOOL_FORMAT) {
+      Serial.println("Warning: dropping " + fName + ", spooled by an older firmware");
+      SPIFFS.remove(fName);
+      continue;
+    }
+    if (priority < 1 || priority > 100) {
+      priority = JOB_PRIORITY_DEFAULT;
+    }
+    addSpooledJob(index, priority, dir.fileSize() - SPOOL_HEADER_SIZE);
+  }
+  if (ramJobIndex != -1 && ramClientId == -1 && !readingRam) {
+    addSpooledJob(ramJobIndex, ramPriority, ramCount);
+  }
+}
+
+void PrintQueue::addSpooledJob(byte index, byte priority, uint32_t size) {
+  if (spooledJobCount == MAX_SPOOLED_JOBS) {
+    spooledJobsOverflowed = true;
+    return;
+  }
+  SpooledJob& job = spooledJobs[spooledJobCount++];
+  job.index = index;
+  job.priority = priority;
+  job.size = size;
+  job.readyAt = millis();
+}
+
+// The waiting job with the highest priority once aged, then the smallest (or the oldest): -1 if
+// there's none. Spool indexes are given out in sequence, so the oldest is the furthest behind head.
+int PrintQueue::findNextJob() {
+  unsigned long now = millis();
+  int best = -1;
+  unsigned long bestPriority = 0;
+  for (int i = 0; i < spooledJobCount; i++) {
+    SpooledJob& job = spooledJobs[i];
+    unsigned long priority = job.priority + (now - job.readyAt) / (JOB_AGING_MS);
+    if (best != -1) {
+      SpooledJob& bestJob = spooledJobs[best];
+      if (priority != bestPriority) {
+        if (priority < bestPriority) {
+          continue;
+        }
+      } else if (SCHEDULE_SHORTEST_FIRST && job.size != bestJob.size) {
+        if (job.size > bestJob.size) {
+          continue;
+        }
+      } else if ((byte) (job.index - head - 1) > (byte) (bestJob.index - head - 1)) {
+        continue;
+      }
+    }
+    best = i;
+    bestPriority = priority;
+  }
+  return best;
+}
+
+byte PrintQueue::startJob(int clientId, compression_type compression, byte priority) {
   head++;
+  writerJobs[clientId] = head;
+  writerPriorities[clientId] = priority;
+  if (ramJobIndex == -1) {
+    ramJobIndex = head;
+    ramClientId = clientId;
+    ramCompression = compression;
+    ramPriority = priority;
+    ramStart = SPOOL_HEADER_SIZE; //lined up with the spool file's data: spills never wrap
+    ramCount = 0;
+    ramSpilled = false;
+    return head;
+  }
   fileWriters[clientId] = SPIFFS.open(printerId + String(head), "w");
+  writeHeader(fileWriters[clientId], compression, priority);
   saveInfo();
+  return head;
 }
 
 void PrintQueue::endJob(int clientId, bool cancel) {
+  if (isRamWriter(clientId)) {
+    if (!ramSpilled) {
+      ramClientId = -1; //stays in RAM until it's printed
+      if (cancel) {
+        releaseRam();
+      } else {
+        addSpooledJob(ramJobIndex, ramPriority, ramCount);
+      }
+      return;
+    } else if (!cancel && !spillRam(true)) {
+      Serial.println("Warning: flash full, the end of the job is lost");
+    }
+    releaseRam();
+  }
   String fName = fileWriters[clientId].name();
+  size_t size = fileWriters[clientId].size();
   fileWriters[clientId].close();
   if (cancel) {
     if(!SPIFFS.remove(fName)) {
@@ -68,40 +181,174 @@ void PrintQueue::endJob(int clientId, bool cancel) {
     }
   } else {
     SPIFFS.rename(fName, fName + "OK");
+    addSpooledJob(writerJobs[clientId], writerPriorities[clientId], size - SPOOL_HEADER_SIZE);
   }
 }
 
-bool PrintQueue::canStoreByte() {
-  return availableFlashSpace > 4096; //4KiB margin
+void PrintQueue::writeHeader(File& file, compression_type compression, byte priority) {
+  byte header[SPOOL_HEADER_SIZE] = {SPOOL_FORMAT, (byte) compression, priority};
+  file.write(header, sizeof(header));
+  availableFlashSpace -= SPOOL_HEADER_SIZE;
+}
+
+bool PrintQueue::isRamWriter(int clientId) {
+  return ramJobIndex != -1 && ramClientId == clientId;
+}
+
+// Writes the oldest data in the RAM spool to the job's file: one block, up to the next
+// SPOOL_SPILL_SIZE boundary of the file, or all of it. False if the flash is full.
+bool PrintQueue::spillRam(bool all) {
+  File& file = fileWriters[ramClientId];
+  if (!ramSpilled) {
+    file = SPIFFS.open(printerId + String(ramJobIndex), "w");
+    writeHeader(file, ramCompression, ramPriority);
+    ramFileSize = SPOOL_HEADER_SIZE;
+    ramSpilled = true;
+    saveInfo();
+  }
+  do {
+    int count = all ? ramCount : min(ramCount, (int) (SPOOL_SPILL_SIZE - ramFileSize % SPOOL_SPILL_SIZE));
+    if (availableFlashSpace < FLASH_SPACE_MARGIN + (size_t) count) {
+      return false;
+    }
+    int firstPart = min(count, SPOOL_RAM_SIZE - ramStart);
+    file.write(ramBuffer + ramStart, firstPart);
+    file.write(ramBuffer, count - firstPart);
+    availableFlashSpace -= count;
+    ramFileSize += count;
+    ramStart = (ramStart + count) % SPOOL_RAM_SIZE;
+    ramCount -= count;
+  } while (all && ramCount > 0);
+  return true;
 }
 
-void PrintQueue::printByte(int clientId, byte b) {
-  fileWriters[clientId].write(b);
-  availableFlashSpace--;
+void PrintQueue::releaseRam() {
+  ramJobIndex = -1;
+  ramClientId = -1;
+  ramCount = 0;
+  readingRam = false;
 }
 
-bool PrintQueue::hasData() {
-  if (fileReader && fileReader.available() > 0) {
+bool PrintQueue::canStoreByte(int clientId) {
+  if (isRamWriter(clientId) && ramCount < SPOOL_RAM_SIZE) {
     return true;
-  } else {
-    if (fileReader) {
-      String fName = fileReader.name();
-      fileReader.close();
-      if(!SPIFFS.remove(fName)) {
-        Serial.println("Warning: failed to remove " + fName);
-      }
+  }
+  return availableFlashSpace > FLASH_SPACE_MARGIN;
+}
+
+size_t PrintQueue::write(int clientId, const byte* data, size_t length) {
+  if (isRamWriter(clientId)) {
+    if (ramCount == SPOOL_RAM_SIZE && !spillRam(false)) {
+      return 0;
     }
-    if (head == tail || SPIFFS.exists(printerId + String(tail + 1))) {
-      return false;
-    } else {
-      tail++;
-      fileReader = SPIFFS.open(printerId + String(tail) + "OK", "r");
-      saveInfo();
-      return fileReader.available() > 0;
+    int count = min((int) length, SPOOL_RAM_SIZE - ramCount);
+    int end = (ramStart + ramCount) % SPOOL_RAM_SIZE;
+    int firstPart = min(count, SPOOL_RAM_SIZE - end);
+    memcpy(ramBuffer + end, data, firstPart);
+    memcpy(ramBuffer, data + firstPart, count - firstPart);
+    ramCount += count;
+    return count;
+  }
+  if (!canStoreByte(clientId)) {
+    return 0;
+  }
+  size_t count = fileWriters[clientId].write(data, min(length, availableFlashSpace - FLASH_SPACE_MARGIN));
+  availableFlashSpace -= count;
+  return count;
+}
+
+bool PrintQueue::startNextJob() {
+  if (spooledJobCount == 0 && spooledJobsOverflowed) {
+    loadSpooledJobs();
+  }
+  int next = findNextJob();
+  if (next == -1) {
+    return false;
+  }
+  readingIndex = spooledJobs[next].index;
+  spooledJobs[next] = spooledJobs[--spooledJobCount];
+  if (readingIndex == ramJobIndex && !ramSpilled) {
+    readingRam = true;
+    readingCompression = ramCompression;
+    return true;
+  }
+  fileReader = SPIFFS.open(printerId + String(readingIndex) + "OK", "r");
+  if (fileReader.available() >= SPOOL_HEADER_SIZE) {
+    fileReader.read(); //the format, checked by loadSpooledJobs()
+    readingCompression = (compression_type) fileReader.read();
+    fileReader.read(); //the priority
+  }
+  return true;
+}
+
+size_t PrintQueue::readData(byte* buffer, size_t length) {
+  if (!readingRam) {
+    return fileReader.read(buffer, length);
+  }
+  int count = min((int) length, ramCount);
+  int firstPart = min(count, SPOOL_RAM_SIZE - ramStart);
+  memcpy(buffer, ramBuffer + ramStart, firstPart);
+  memcpy(buffer + firstPart, ramBuffer, count - firstPart);
+  ramStart = (ramStart + count) % SPOOL_RAM_SIZE;
+  ramCount -= count;
+  return count;
+}
+
+bool PrintQueue::hasCurrentData() {
+  if (readingRam) {
+    return ramCount > 0;
+  }
+  return fileReader && fileReader.available() > 0;
+}
+
+void PrintQueue::finishJob() {
+  if (readingRam) {
+    releaseRam();
+  } else if (fileReader) {
+    String fName = fileReader.name();
+    fileReader.close();
+    if(!SPIFFS.remove(fName)) {
+      Serial.println("Warning: failed to remove " + fName);
+    }
+  }
+  readingIndex = -1;
+  readingCompression = COMPRESSION_NONE;
+}
+
+compression_type PrintQueue::getReadingCompression() {
+  return readingCompression;
+}
+
+int PrintQueue::getReadingJob() {
+  return readingIndex;
+}
+
+void PrintQueue::cancelJob(byte index) {
+  for (int i = 0; i < spooledJobCount; i++) {
+    if (spooledJobs[i].index == index) {
+      spooledJobs[i] = spooledJobs[--spooledJobCount];
+      break;
     }
   }
+  if (index == readingIndex) {
+    fileReader.close();
+    readingIndex = -1;
+    readingCompression = COMPRESSION_NONE;
+  }
+  if (index == ramJobIndex) {
+    releaseRam();
+    return;
+  }
+  String fName = printerId + String(index) + "OK";
+  if (!SPIFFS.remove(fName)) {
+    Serial.println("Warning: failed to remove " + fName);
+  }
+}
+
+int PrintQueue::getJobCount() {
+  return spooledJobCount;
 }
 
-byte PrintQueue::readData() {
-  return fileReader.read();
+const SpooledJob& PrintQueue::getJob(int i) {
+  return spooledJobs[i];
 }
@@ -19,6 +19,15 @@
 #include <Arduino.h>
 #include <FS.h>
 #include "Settings.h"
+#include "Inflater.h"
+
+// a completely spooled job, waiting to be printed
+struct SpooledJob {
+  byte index;
+  byte priority;
+  uint32_t size;
+  unsigned long readyAt; //millis()
+};
 
 class PrintQueue {
   private:
@@ -26,20 +35,67 @@ class PrintQueue {
 
     String printerId;
     File fileWriters[MAXCLIENTS];
+    // the spool index and the priority of the job each client is writing
+    byte writerJobs[MAXCLIENTS];
+    byte writerPriorities[MAXCLIENTS];
     File fileReader;
+    compression_type readingCompression = COMPRESSION_NONE;
+    // the last spool index given out, and the one being read (-1 if none)
     byte head;
-    byte tail;
+    int readingIndex = -1;
+    // The jobs waiting to be printed, in no particular order: the next one is picked from them.
+    // When it overflows, the jobs left out are found on the flash once it has emptied.
+    SpooledJob spooledJobs[MAX_SPOOLED_JOBS];
+    int spooledJobCount = 0;
+    bool spooledJobsOverflowed = false;
+    // The RAM spool, a ring holding the data of one job: -1 for the job index when it's free, and
+    // -1 for the client once the job is completely received. Once a job has spilled (to the file
+    // of its client's writer), the rest of it goes to the file when the job ends.
+    byte* ramBuffer = NULL;
+    int ramJobIndex = -1;
+    int ramClientId = -1;
+    compression_type ramCompression;
+    byte ramPriority;
+    int ramStart = 0;
+    int ramCount = 0;
+    bool ramSpilled = false;
+    size_t ramFileSize = 0;
+    bool readingRam = false;
+
     void saveInfo();
+    void writeHeader(File& file, compression_type compression, byte priority);
     void loadInfo();
+    bool isRamWriter(int clientId);
+    bool spillRam(bool all);
+    void releaseRam();
+    void addSpooledJob(byte index, byte priority, uint32_t size);
+    void loadSpooledJobs();
+    int findNextJob();
   public:
     static void updateAvailableFlashSpace();
 
     PrintQueue(String _printerId);
     void init();
-    void startJob(int clientId);
+    // Spool files start with a two byte header: the compression of the data, which is stored as
+    // it was received, and the priority of the job. Returns the index of the spool file (which a
+    // job held in the RAM spool only gets if it spills).
+    byte startJob(int clientId, compression_type compression, byte priority = JOB_PRIORITY_DEFAULT);
     void endJob(int clientId, bool cancel);
-    bool canStoreByte();
-    void printByte(int clientId, byte b);
-    bool hasData();
-    byte readData();
+    bool canStoreByte(int clientId);
+    // returns how much was stored: less than length once the flash is nearly full
+    size_t write(int clientId, const byte* data, size_t length);
+    // Starts reading the job that should be printed next: false if none is waiting. The job's data
+    // is read until hasCurrentData() is false, then finishJob() drops it.
+    bool startNextJob();
+    size_t readData(byte* buffer, size_t length);
+    bool hasCurrentData();
+    void finishJob();
+    compression_type getReadingCompression();
+    // the spool index of the job being read, -1 if none
+    int getReadingJob();
+    // drops a completely spooled job, even while it's being read
+    void cancelJob(byte index);
+    // completely spooled jobs not yet being printed
+    int getJobCount();
+    const SpooledJob& getJob(int i);
 };
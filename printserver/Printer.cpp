@@ -19,10 +19,21 @@
 
 Printer::Printer(String _printerId): queue(_printerId) {
   name = _printerId;
+  for (int i = 0; i < MAXCLIENTS; i++) {
+    clientJobs[i] = NULL;
+  }
 }
 
+// the jobs left in the spool from before a restart are listed again, nameless
 void Printer::init() {
   queue.init();
+  for (int i = 0; i < queue.getJobCount(); i++) {
+    const SpooledJob& spooled = queue.getJob(i);
+    Job* job = jobs.add(-1, spooled.index, "", spooled.priority);
+    if (job != NULL) {
+      job->bytes = spooled.size;
+    }
+  }
 }
 
 void Printer::startJob() {
@@ -31,55 +42,292 @@ void Printer::startJob() {
 void Printer::endJob() {
 }
 
-void Printer::startJob(int clientId) {
-  if (status == IDLE) {
+size_t Printer::write(const byte* data, size_t length) {
+  size_t count = 0;
+  while (count < length && canPrint()) {
+    printByte(data[count++]);
+  }
+  return count;
+}
+
+uint32_t Printer::createJob(int clientId, const char* jobName, byte priority) {
+  clientJobs[clientId] = jobs.add(clientId, -1, jobName, priority);
+  return clientJobs[clientId]->id;
+}
+
+bool Printer::canAcceptJob() {
+  return jobs.hasRoom();
+}
+
+uint32_t Printer::startJob(int clientId, const char* jobName, compression_type compression, byte priority) {
+  uint32_t jobId = createJob(clientId, jobName, priority);
+  startDocument(clientId, compression);
+  return jobId;
+}
+
+// The first document decides whether the job is printed directly or spooled, and the next ones
+// carry on with the same output: the inflater (or a spool file reader) takes the compressed
+// streams one after the other. A compressed job is only printed directly if it can have the
+// inflater, otherwise it's spooled as it is and inflated later.
+bool Printer::startDocument(int clientId, compression_type compression) {
+  Job* job = clientJobs[clientId];
+  if (job == directJob || job->spoolIndex != -1) {
+    return compression == clientCompressions[clientId];
+  }
+  clientCompressions[clientId] = compression;
+  if (status == IDLE && (compression == COMPRESSION_NONE || inflater.begin(compression) == INFLATE_STARTED)) {
     status = PRINTING_FROM_SERVER;
     printingClientId = clientId;
     startJob();
+    job->state = JOB_PROCESSING;
+    directJob = job;
   } else {
-    queue.startJob(clientId);
+    job->spoolIndex = queue.startJob(clientId, compression, job->priority);
   }
+  return true;
 }
 
-void Printer::endJob(int clientId, bool cancel) {
-  if (status == PRINTING_FROM_SERVER && printingClientId == clientId) {
-    status = IDLE;
-    endJob();
+void Printer::finishDirectJob(job_state state) {
+  if (inflater.hasFailed() && state == JOB_COMPLETED) {
+    state = JOB_ABORTED;
+  }
+  inflater.end();
+  status = IDLE;
+  endJob();
+  jobs.finish(directJob, state);
+  directJob = NULL;
+}
+
+// state: JOB_COMPLETED once all the data is in, JOB_CANCELED or JOB_ABORTED to drop the job
+void Printer::endJob(int clientId, job_state state) {
+  Job* job = clientJobs[clientId];
+  bool cancel = state != JOB_COMPLETED;
+  clientJobs[clientId] = NULL;
+  job->clientId = -1;
+  if (job != directJob && job->spoolIndex == -1) { //no document was sent
+    jobs.finish(job, state);
+  } else if (status == PRINTING_FROM_SERVER && printingClientId == clientId) {
+    if (inflater.isActive() && !cancel) {
+      printingClientId = -1; //processQueue() prints what's left in the inflater, then finishes the job
+    } else {
+      finishDirectJob(state);
+    }
   } else {
     queue.endJob(clientId, cancel);
+    if (cancel) {
+      jobs.finish(job, state);
+    }
   }
 }
 
+bool Printer::cancelJob(uint32_t jobId) {
+  Job* job = jobs.find(jobId);
+  if (job == NULL || job->isFinished()) {
+    return false;
+  }
+  if (job->clientId != -1) {
+    job->cancelRequested = true; //endJob() finishes it once the server has dropped the connection
+  } else if (job == directJob) {
+    finishDirectJob(JOB_CANCELED);
+  } else {
+    queue.cancelJob(job->spoolIndex);
+    if (job->spoolIndex == queueJobSpoolIndex) {
+      inflater.end();
+      queueDataCount = 0;
+    }
+    jobs.finish(job, JOB_CANCELED);
+  }
+  return true;
+}
+
+bool Printer::isCancelRequested(int clientId) {
+  return clientJobs[clientId] != NULL && clientJobs[clientId]->cancelRequested;
+}
+
+JobTable& Printer::getJobs() {
+  return jobs;
+}
+
+bool Printer::isPrintingDirectly(int clientId) {
+  return status == PRINTING_FROM_SERVER && printingClientId == clientId;
+}
+
 bool Printer::canPrint(int clientId) {
-  if (status == PRINTING_FROM_SERVER && printingClientId == clientId) {
-    return canPrint();
+  if (isPrintingDirectly(clientId)) {
+    return inflater.isActive() ? inflater.inputRoom() > 0 : canPrint();
   } else {
-    return queue.canStoreByte();
+    return queue.canStoreByte(clientId);
   }
 }
 
-void Printer::printByte(int clientId, byte b) {
-  if (status == PRINTING_FROM_SERVER && printingClientId == clientId) {
-    printByte(b);
+size_t Printer::write(int clientId, const byte* data, size_t length) {
+  size_t count;
+  if (isPrintingDirectly(clientId)) {
+    if (inflater.isActive()) {
+      count = inflater.write(data, length);
+      drainInflater();
+    } else {
+      count = write(data, length);
+      printedBytes += count;
+    }
   } else {
-    queue.printByte(clientId, b);
+    count = queue.write(clientId, data, length);
+    spooledBytes += count;
+  }
+  clientJobs[clientId]->bytes += count;
+  receivedBytes += count;
+  return count;
+}
+
+// prints what the inflater can produce; false if the printer stopped taking it first
+bool Printer::drainInflater() {
+  while (canPrint()) {
+    int result = inflater.read();
+    if (result < 0) {
+      return true;
+    }
+    printedBytes++;
+    printByte(result);
+  }
+  return false;
+}
+
+// For a compressed spool file: feeds it to the inflater a piece at a time. True once all of it
+// has been printed, so that the job can be finished.
+bool Printer::inflateQueueData() {
+  if (!inflater.isActive()) {
+    int result = inflater.begin(queue.getReadingCompression());
+    if (result == INFLATE_BUSY) {
+      return false; //the other printer has the window: wait for it
+    } else if (result == INFLATE_NO_MEMORY) {
+      Serial.println("Not enough memory to inflate the spooled job, aborting it");
+      queue.finishJob(); //drops the rest of it
+      queueJobFailed = true;
+      return true;
+    }
+  }
+  byte buffer[128];
+  size_t room = inflater.inputRoom();
+  if (room > 0 && queue.hasCurrentData()) {
+    inflater.write(buffer, queue.readData(buffer, min(room, sizeof(buffer))));
+  }
+  if (!drainInflater() || queue.hasCurrentData()) {
+    return false;
+  }
+  queueJobFailed = inflater.hasFailed();
+  inflater.end();
+  return true;
+}
+
+// true once the printer has taken the whole block
+bool Printer::printQueueData() {
+  size_t count = write(queueData + queueDataStart, queueDataCount);
+  printedBytes += count;
+  queueDataStart += count;
+  queueDataCount -= count;
+  return queueDataCount == 0;
+}
+
+void Printer::finishQueueJob() {
+  queue.finishJob();
+  jobs.finish(jobs.findSpooled(queueJobSpoolIndex), queueJobFailed ? JOB_ABORTED : JOB_COMPLETED);
+  queueJobFailed = false;
+  queueJobSpoolIndex = -1;
+}
+
+// the queue picks the job: follow it in the job table
+void Printer::startQueueJob() {
+  queueJobSpoolIndex = queue.getReadingJob();
+  Job* job = jobs.findSpooled(queueJobSpoolIndex);
+  if (job == NULL) { //one found on the flash when the spool index had overflowed
+    job = jobs.add(-1, queueJobSpoolIndex, "");
+  }
+  if (job != NULL) {
+    job->state = JOB_PROCESSING;
   }
 }
 
 void Printer::processQueue() {
-  if (status == PRINTING_FROM_QUEUE) {
-    if (queue.hasData()) {
-      if(canPrint()) {
-        printByte(queue.readData());
+  unsigned long start = micros();
+  uint32_t startBytes = printedBytes;
+  for (int count = 0; count < JOB_BYTE_BUDGET && processQueueStep(); count++) {
+    if (printedBytes - startBytes >= JOB_BYTE_BUDGET || micros() - start > JOB_TIME_BUDGET_US) {
+      break;
+    }
+  }
+}
+
+// true if there may be more to do right away
+bool Printer::processQueueStep() {
+  if (status == PRINTING_FROM_SERVER) {
+    // a compressed job: the inflater may hold output the printer couldn't take yet
+    if (inflater.isActive() && drainInflater() && printingClientId == -1) {
+      finishDirectJob(JOB_COMPLETED);
+    }
+    return false; //drainInflater() already went on until the printer was busy
+  } else if (status == PRINTING_FROM_QUEUE) {
+    if (queueDataCount > 0) {
+      return printQueueData(); //the rest of a block the printer didn't take at once
+    }
+    if (queue.getReadingCompression() != COMPRESSION_NONE && !inflateQueueData()) {
+      return inflater.isActive() && canPrint(); //the inflater wants more input
+    }
+    if (queue.hasCurrentData()) {
+      if (queue.getReadingCompression() == COMPRESSION_NONE && canPrint()) {
+        queueDataStart = 0;
+        queueDataCount = queue.readData(queueData, sizeof(queueData));
+        return printQueueData();
       }
+      return queue.getReadingCompression() != COMPRESSION_NONE;
     } else {
       status = IDLE;
+      finishQueueJob();
+      return true; //the next one can start right away
     }
-  } else if (status == IDLE && queue.hasData()) {
+  } else if (status == IDLE && queue.startNextJob()) {
     status = PRINTING_FROM_QUEUE;
+    startQueueJob();
+    return true;
   }
+  return false;
+}
+
+void Printer::recordFlowState(int clientId, bool dataAvailable, bool canPrint, unsigned long elapsedMicros) {
+  if (dataAvailable && !canPrint) {
+    blockedMicros += elapsedMicros;
+  } else if (!dataAvailable && canPrint && isPrintingDirectly(clientId)) {
+    starvedMicros += elapsedMicros; //only the client being printed directly can starve the printer
+  }
+}
+
+unsigned long Printer::getStarvedMillis() {
+  return starvedMicros / 1000;
+}
+
+unsigned long Printer::getBlockedMillis() {
+  return blockedMicros / 1000;
+}
+
+uint32_t Printer::getReceivedBytes() {
+  return receivedBytes;
+}
+
+uint32_t Printer::getPrintedBytes() {
+  return printedBytes;
+}
+
+uint32_t Printer::getSpooledBytes() {
+  return spooledBytes;
+}
+
+printer_status Printer::getStatus() {
+  return status;
+}
+
+int Printer::getQueuedJobCount() {
+  return queue.getJobCount() + (status == IDLE ? 0 : 1);
 }
 
-String Printer::getName() {
+const String& Printer::getName() {
   return name;
 }
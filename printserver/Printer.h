@@ -18,6 +18,7 @@
 #pragma once
 #include <Arduino.h>
 #include "PrintQueue.h"
+#include "JobTable.h"
 
 typedef enum {
   IDLE,
@@ -30,7 +31,37 @@ class Printer {
     printer_status status = IDLE;
     int printingClientId = 0;
     PrintQueue queue;
+    JobTable jobs;
+    // the jobs being received, by client slot, and the compression of their documents
+    Job* clientJobs[MAXCLIENTS];
+    compression_type clientCompressions[MAXCLIENTS];
+    // the spooled job being printed, -1 if none
+    int queueJobSpoolIndex = -1;
+    bool queueJobFailed = false;
+    Job* directJob = NULL;
+    // decompresses the job being printed, when it came compressed
+    Inflater inflater;
+    // a block read from the spool, and what's left of it for the printer
+    byte queueData[PRINT_QUEUE_READ_SIZE];
+    int queueDataStart = 0;
+    int queueDataCount = 0;
     String name;
+    // time spent with the printer ready but no data to give it, and with data waiting but the
+    // printer (or the spool) unable to take it
+    unsigned long long starvedMicros = 0;
+    unsigned long long blockedMicros = 0;
+    // bytes taken from the clients, given to the printer and written to the spool, since startup
+    uint32_t receivedBytes = 0;
+    uint32_t printedBytes = 0;
+    uint32_t spooledBytes = 0;
+
+    void startQueueJob();
+    void finishQueueJob();
+    void finishDirectJob(job_state state);
+    bool drainInflater();
+    bool inflateQueueData();
+    bool printQueueData();
+    bool processQueueStep();
   protected:
     Printer(String _printerId);
     // startJob() and endJob() do nothing by default, and can be overriden if a specifica
@@ -39,13 +70,43 @@ class Printer {
     virtual void endJob();
     virtual bool canPrint() = 0;
     virtual void printByte(byte b) = 0;
+    // Gives the printer as much as it takes without waiting, and returns how much that was. By
+    // default it's a byte at a time through canPrint() and printByte(): ports that can take a
+    // whole block at once override it.
+    virtual size_t write(const byte* data, size_t length);
   public:
     void init();
-    void startJob(int clientId);
-    void endJob(int clientId, bool cancel);
+    // A job holds its client slot from createJob() to endJob(), and its documents are received on
+    // it one after the other, each started with startDocument(). startJob() does both for a job
+    // with a single document. Returns the job id.
+    uint32_t createJob(int clientId, const char* jobName = NULL, byte priority = JOB_PRIORITY_DEFAULT);
+    uint32_t startJob(int clientId, const char* jobName = NULL, compression_type compression = COMPRESSION_NONE, byte priority = JOB_PRIORITY_DEFAULT);
+    // false while the job table is full of unfinished jobs: checked before a job is admitted
+    bool canAcceptJob();
+    // false if the compression differs from the job's previous documents
+    bool startDocument(int clientId, compression_type compression);
+    void endJob(int clientId, job_state state);
+    // returns false if there's no such job, or if it's already finished
+    bool cancelJob(uint32_t jobId);
+    // a Cancel-Job arrived for the job the client is sending: the server should drop the connection
+    bool isCancelRequested(int clientId);
+    JobTable& getJobs();
     bool canPrint(int clientId);
-    void printByte(int clientId, byte b);
+    // the client's job goes straight to the printer, rather than to the spool
+    bool isPrintingDirectly(int clientId);
+    // the client's data, to the printer or the spool: returns how much of it was taken
+    size_t write(int clientId, const byte* data, size_t length);
+    // prints from the spool (or what the inflater holds), within the job budget of a loop pass
     void processQueue();
-    String getName();
+    void recordFlowState(int clientId, bool dataAvailable, bool canPrint, unsigned long elapsedMicros);
+    unsigned long getStarvedMillis();
+    unsigned long getBlockedMillis();
+    uint32_t getReceivedBytes();
+    uint32_t getPrintedBytes();
+    uint32_t getSpooledBytes();
+    printer_status getStatus();
+    // the job being printed and the spooled ones
+    int getQueuedJobCount();
+    const String& getName();
     virtual String getInfo() = 0;
 };
@@ -0,0 +1,63 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "RequestRouter.h"
+
+int RequestRouter::compare(const char* method, const char* path, const Route& route) {
+  int result = strcmp(method, route.method);
+  return result != 0 ? result : strcmp(path, route.path);
+}
+
+bool RequestRouter::add(const char* method, const char* path, int target) {
+  if (routeCount == MAX_ROUTES) {
+    Serial.printf("No room for route %s /%s\r\n", method, path);
+    return false;
+  }
+  int position = routeCount;
+  while (position > 0 && compare(method, path, routes[position - 1]) <= 0) {
+    if (compare(method, path, routes[position - 1]) == 0) {
+      return false;
+    }
+    position--;
+  }
+  for (int i = routeCount; i > position; i--) {
+    routes[i] = routes[i - 1];
+  }
+  routes[position] = {method, path, target};
+  routeCount++;
+  return true;
+}
+
+int RequestRouter::find(const char* method, const char* path) const {
+  if (path[0] != '/') {
+    return -1;
+  }
+  int low = 0;
+  int high = routeCount - 1;
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    int result = compare(method, path + 1, routes[middle]);
+    if (result == 0) {
+      return routes[middle].target;
+    } else if (result < 0) {
+      high = middle - 1;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return -1;
+}
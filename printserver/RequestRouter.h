@@ -0,0 +1,44 @@
+/*
+    This file is part of printserver-esp8266.
+
+    printserver-esp8266 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    printserver-esp8266 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with printserver-esp8266.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <Arduino.h>
+
+// the web endpoints, plus one IPP route per printer
+#define MAX_ROUTES 16
+
+struct Route {
+  const char* method;
+  const char* path; //without the leading '/'
+  int target;
+};
+
+// Maps a request method and path to a target (a printer index, a web endpoint...). The routes are
+// added once at startup and kept sorted, so a lookup is a binary search with no allocation. The
+// strings aren't copied: they have to live as long as the router.
+class RequestRouter {
+  private:
+    Route routes[MAX_ROUTES];
+    int routeCount = 0;
+
+    static int compare(const char* method, const char* path, const Route& route);
+  public:
+    // false if the route is already there, or there's no room left
+    bool add(const char* method, const char* path, int target);
+    // -1 if nothing matches
+    int find(const char* method, const char* path) const;
+};
@@ -22,13 +22,19 @@ SerialPortPrinter::SerialPortPrinter(String _printerId, Stream* s): Printer(_pri
 }
 
 bool SerialPortPrinter::canPrint() {
-  return true;
+  return stream->availableForWrite() > 0;
 }
 
 void SerialPortPrinter::printByte(byte b) {
   stream->write(b);
 }
 
+// only what the UART's FIFO has room for: the stream would wait for the rest
+size_t SerialPortPrinter::write(const byte* data, size_t length) {
+  size_t room = max(stream->availableForWrite(), 0);
+  return room > 0 ? stream->write(data, min(length, room)) : 0;
+}
+
 String SerialPortPrinter::getInfo() {
   return "Serial port printer";
 }
@@ -24,6 +24,7 @@ class SerialPortPrinter: public Printer {
   protected:
     bool canPrint();
     void printByte(byte b);
+    size_t write(const byte* data, size_t length);
   public:
     SerialPortPrinter(String _printerId, Stream* s);
     String getInfo();
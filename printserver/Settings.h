@@ -18,10 +18,87 @@
 #pragma once
 
 #define MAXCLIENTS 4
+#define MAX_PENDING_CLIENTS 2
+// persistent IPP connections between two requests: they hold no buffer, only a connection object
+#define MAX_IDLE_IPP_CLIENTS 2
+// a printer can't take every client slot, and no job is admitted when the heap runs this low
+#define MAX_CLIENTS_PER_PRINTER (MAXCLIENTS - 1)
+#define ADMISSION_MIN_FREE_HEAP 8192
 
+// shared send/receive buffers: one full TCP segment each (TCP_MSS with the lwIP "higher bandwidth" variant)
+#define IO_BUFFER_SIZE 1460
+#define IO_BUFFER_COUNT (MAXCLIENTS + MAX_PENDING_CLIENTS + 2)
+
+// a connection stops reading from its socket (letting the TCP window close) once this many bytes
+// are buffered. One printed directly resumes when the printer has drained it down to the low
+// watermark: the socket is read in large blocks, with half a buffer left to keep the printer going.
+// One that is parsed or spooled is drained in one go, and resumes as soon as there's room.
+#define RECEIVE_HIGH_WATERMARK IO_BUFFER_SIZE
+#define RECEIVE_LOW_WATERMARK (IO_BUFFER_SIZE / 2)
+
+// each pass of the main loop moves up to this many bytes of every job (received, or printed from
+// the spool), and spends at most this long on each; the listeners, pending requests and timeouts
+// are looked at once per service interval
+#define JOB_BYTE_BUDGET 1024
+#define JOB_TIME_BUDGET_US 2000
+#define SERVICE_INTERVAL_MS 5
+// a parallel port strobes out a block byte by byte, for at most this long per write() call
+#define PARALLEL_WRITE_TIME_US 500
+
+// jobs kept per printer, finished ones included: room for a full spool index, the jobs being
+// received and the one being printed. Unfinished jobs are never evicted, so the printer refuses
+// new ones while the table holds nothing else.
+#define JOB_TABLE_SIZE (MAX_SPOOLED_JOBS + MAXCLIENTS + 2)
+#define JOB_NAME_LENGTH 23
+
+// A client slot is reclaimed when its client sends nothing for CLIENT_IDLE_TIMEOUT_MS, and the
+// job ends with what it got; or when no data moves for JOB_TIMEOUT_MS, and the job is aborted
+#define CLIENT_IDLE_TIMEOUT_MS 90*1000
 #define JOB_TIMEOUT_MS 4*60*1000
 #define NETWORK_READ_TIMEOUT_MS 10*1000
+// a request (its head, and the IPP operation up to the document) has this long to arrive in full,
+// however slowly it trickles in, from its first byte; an idle persistent connection is closed when
+// the next request hasn't started after KEEP_ALIVE_TIMEOUT_MS
+#define REQUEST_TIMEOUT_MS 10*1000
+#define KEEP_ALIVE_TIMEOUT_MS 5*1000
+
+// the spool is read this much at a time, into a buffer every printer has
+#define PRINT_QUEUE_READ_SIZE 128
+// Every printer has a RAM spool that takes a spooled job before the flash does: a job that fits
+// never touches the flash, a bigger one spills to its spool file in SPOOL_SPILL_SIZE blocks that
+// start on SPOOL_SPILL_SIZE boundaries of the file (SPOOL_RAM_SIZE must be a multiple of it).
+#define SPOOL_RAM_SIZE 4096
+#define SPOOL_SPILL_SIZE 1024
+// Spooled jobs are printed by their IPP job-priority (1 to 100, the highest first), and a job
+// gains a level for every JOB_AGING_MS it waits so that none waits forever. Among equals the
+// smallest goes first with SCHEDULE_SHORTEST_FIRST, otherwise the oldest. The queue keeps up to
+// MAX_SPOOLED_JOBS of them in RAM, the others wait on the flash until it has room again.
+#define JOB_PRIORITY_DEFAULT 50
+#define JOB_AGING_MS 10*1000
+#define SCHEDULE_SHORTEST_FIRST 1
+#define MAX_SPOOLED_JOBS 32
+
+// room for the serialized printer attributes of each printer, with the longest IP address in its URI
+#define IPP_ATTRIBUTES_SIZE 1024
+
+// networks kept from the last background scan, and how old they can get before the WiFi page asks
+// for a new scan
+#define WIFI_SCAN_CACHE_SIZE 16
+#define WIFI_SCAN_MAX_AGE_MS 30*1000
+// longest body of a web page request: the WiFi form, with an SSID and a password percent-encoded
+#define WEB_FORM_MAX_LENGTH 320
+
+// set to 0 to compile the loop profiler out; with it, the phase timings are on /profile and printed
+// to Serial every LOOP_PROFILER_REPORT_MS. A measured phase costs two cycle counter reads and a
+// histogram update: some 60 cycles by estimate (no clz instruction on the LX106, so that's a
+// libgcc call), under 1 us at 80 MHz. A loop pass measures 4 phases, 9 once per service
+// interval, so a few us. calibrate() measures the real cost at startup: the report's last line.
+#define LOOP_PROFILER_ENABLED 1
+#define LOOP_PROFILER_REPORT_MS 60*1000
 
+// the first printer takes raw (AppSocket) jobs on SOCKET_SERVER_PORT, the next ones on the ports
+// that follow, up to this many printers
 #define SOCKET_SERVER_PORT 9100
+#define MAX_SOCKET_SERVERS 4
 #define IPP_SERVER_PORT 631
 #define HTTP_SERVER_PORT 80
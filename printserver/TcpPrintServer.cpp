@@ -17,138 +17,521 @@
 
 #include "WiFiManager.h"
 #include "Settings.h"
-#include "HttpStream.h"
-#include "IppStream.h"
 #include "TcpPrintServer.h"
 
-TcpPrintServer::TcpPrintServer(Printer** _printers, int _printerCount) : socketServer(SOCKET_SERVER_PORT), ippServer(IPP_SERVER_PORT), httpServer(HTTP_SERVER_PORT) {
+// the labels of the timeout counters on /metrics, by timeout_kind
+static const char* timeoutNames[TIMEOUT_KIND_COUNT] = {"idle_client", "stalled_job", "next_document", "request", "keep_alive"};
+
+// the per-printer series on /metrics
+struct PrinterMetric {
+  const char* name;
+  const char* type;
+  unsigned long (*value)(Printer* printer);
+};
+static const PrinterMetric printerMetrics[] = {
+  {"printserver_received_bytes_total", "counter", [](Printer* p) -> unsigned long { return p->getReceivedBytes(); }},
+  {"printserver_printed_bytes_total", "counter", [](Printer* p) -> unsigned long { return p->getPrintedBytes(); }},
+  {"printserver_spooled_bytes_total", "counter", [](Printer* p) -> unsigned long { return p->getSpooledBytes(); }},
+  {"printserver_jobs_started_total", "counter", [](Printer* p) -> unsigned long { return p->getJobs().getAddedCount(); }},
+  {"printserver_jobs_completed_total", "counter", [](Printer* p) -> unsigned long { return p->getJobs().getFinishedCount(JOB_COMPLETED); }},
+  {"printserver_jobs_canceled_total", "counter", [](Printer* p) -> unsigned long { return p->getJobs().getFinishedCount(JOB_CANCELED); }},
+  {"printserver_jobs_aborted_total", "counter", [](Printer* p) -> unsigned long { return p->getJobs().getFinishedCount(JOB_ABORTED); }},
+  {"printserver_blocked_milliseconds_total", "counter", [](Printer* p) -> unsigned long { return p->getBlockedMillis(); }},
+  {"printserver_starved_milliseconds_total", "counter", [](Printer* p) -> unsigned long { return p->getStarvedMillis(); }},
+  {"printserver_queued_jobs", "gauge", [](Printer* p) -> unsigned long { return p->getQueuedJobCount(); }}
+};
+
+TcpPrintServer::TcpPrintServer(Printer** _printers, int _printerCount) : ippServer(IPP_SERVER_PORT), httpServer(HTTP_SERVER_PORT) {
   printers = _printers;
   printerCount = _printerCount;
+  socketServerCount = min(printerCount, MAX_SOCKET_SERVERS);
+  for (int i = 0; i < socketServerCount; i++) {
+    socketServers[i] = new WiFiServer(SOCKET_SERVER_PORT + i);
+  }
+  attributeCaches = new IppAttributeCache[printerCount];
   for (int i = 0; i < MAXCLIENTS; i++) {
     clients[i] = NULL;
+    clientSlotHeld[i] = false;
+  }
+  for (int i = 0; i < TIMEOUT_KIND_COUNT; i++) {
+    timeouts[i] = 0;
+  }
+  for (int i = 0; i < MAX_PENDING_CLIENTS; i++) {
+    pendingIppClients[i] = NULL;
+  }
+  for (int i = 0; i < MAX_IDLE_IPP_CLIENTS; i++) {
+    idleIppClients[i] = NULL;
+  }
+  for (int i = 0; i < printerCount; i++) {
+    printerRoutes.add("POST", printers[i]->getName().c_str(), i);
   }
+  webRoutes.add("GET", "", WEB_HOME);
+  webRoutes.add("GET", "printerInfo", WEB_PRINTER_INFO);
+  webRoutes.add("GET", "wifi", WEB_WIFI);
+  webRoutes.add("POST", "wifi-connect", WEB_WIFI_CONNECT);
+  webRoutes.add("GET", "metrics", WEB_METRICS);
+#if LOOP_PROFILER_ENABLED
+  webRoutes.add("GET", "profile", WEB_PROFILE);
+#endif
 }
 
+void TcpPrintServer::attachClient(int index, TcpStream* client, int printerIndex, bool lastDocument) {
+  clients[index] = client;
+  clientTargetPrinters[index] = printerIndex;
+  clientLastPass[index] = micros();
+  clientLastActivity[index] = millis();
+  clientLastProgress[index] = millis();
+  clientLastDocument[index] = lastDocument;
+  clientSlotHeld[index] = false;
+  admission.setHeld(index, false);
+  clientReceivedBytes[index] = 0;
+}
+
+void TcpPrintServer::holdClientSlot(int index) {
+  clientSlotHeld[index] = true;
+  admission.setHeld(index, true);
+  clientHeldSince[index] = millis();
+}
+
+// once the printer has decided between printing the job directly and spooling it
+void TcpPrintServer::setClientWatermarks(int index) {
+  if (printers[clientTargetPrinters[index]]->isPrintingDirectly(index)) {
+    clients[index]->setWatermarks(RECEIVE_LOW_WATERMARK, RECEIVE_HIGH_WATERMARK);
+  } else {
+    clients[index]->setWatermarks(RECEIVE_HIGH_WATERMARK - 1, RECEIVE_HIGH_WATERMARK);
+  }
+}
+
+uint32_t TcpPrintServer::startClientJob(int index, TcpStream* client, int printerIndex, const char* jobName, compression_type compression, byte priority) {
+  attachClient(index, client, printerIndex, true);
+  uint32_t jobId = printers[printerIndex]->startJob(index, jobName, compression, priority);
+  setClientWatermarks(index);
+  return jobId;
+}
+
+// moves a batch of the job's data, as much as the printer takes within the job's budget
 void TcpPrintServer::handleClient(int index) {
   Printer* printer = printers[clientTargetPrinters[index]];
-  if (clients[index]->hasMoreData()) {
-    if (clients[index]->dataAvailable() && printer->canPrint(index)) {
-      printer->printByte(index, clients[index]->read());
+  TcpStream* client = clients[index];
+  bool cancel = printer->isCancelRequested(index);
+  if (client->hasMoreData() && !cancel) {
+    unsigned long now = micros();
+    bool dataAvailable = client->dataAvailable();
+    bool canPrint = printer->canPrint(index);
+    printer->recordFlowState(index, dataAvailable, canPrint, now - clientLastPass[index]);
+    clientLastPass[index] = now;
+    if (dataAvailable) {
+      clientLastActivity[index] = millis();
+      if (canPrint) {
+        clientLastProgress[index] = clientLastActivity[index];
+      }
+    }
+    // blocks go from the receive buffer to the printer without a copy
+    for (size_t count = 0; dataAvailable && canPrint && count < JOB_BYTE_BUDGET; ) {
+      const byte* data;
+      size_t length = client->peekData(&data);
+      size_t written = printer->write(index, data, min(length, JOB_BYTE_BUDGET - count));
+      client->consumeData(written);
+      clientReceivedBytes[index] += written;
+      count += written;
+      if (written == 0 || !client->hasMoreData() || micros() - now > JOB_TIME_BUDGET_US) {
+        break;
+      }
+      dataAvailable = client->dataAvailable();
+      canPrint = printer->canPrint(index);
     }
+  } else if (clientLastDocument[index] || cancel) {
+    Serial.println(cancel ? "Job canceled" : "Disconnected");
+    endClientJob(index, cancel ? JOB_CANCELED : JOB_COMPLETED);
   } else {
-    Serial.println("Disconnected");
-    delete clients[index];
+    Serial.println("Document received, waiting for the next one");
+    clients[index]->close();
+    clients[index] = NULL;
+    holdClientSlot(index);
+  }
+}
+
+// closes the connection (if there's still one) and gives the slot back
+void TcpPrintServer::endClientJob(int index, job_state state) {
+  if (clients[index] != NULL) {
+    clients[index]->close();
     clients[index] = NULL;
-    printer->endJob(index, false);
+  }
+  clientSlotHeld[index] = false;
+  printers[clientTargetPrinters[index]]->endJob(index, state);
+  admission.release(index);
+}
+
+// A client that went quiet ends its job with what it sent, like a closed connection would. One
+// whose data hasn't moved at all for JOB_TIMEOUT_MS (the printer is stuck) has its job aborted.
+void TcpPrintServer::reclaimStuckClient(int index) {
+  unsigned long now = millis();
+  if (now - clientLastActivity[index] > CLIENT_IDLE_TIMEOUT_MS) {
+    Serial.println("Client idle, ending its job");
+    timeouts[TIMEOUT_IDLE_CLIENT]++;
+    endClientJob(index, JOB_COMPLETED);
+  } else if (now - clientLastProgress[index] > JOB_TIMEOUT_MS) {
+    Serial.println("Job stalled, aborting it");
+    timeouts[TIMEOUT_STALLED_JOB]++;
+    endClientJob(index, JOB_ABORTED);
+  }
+}
+
+// A job between two documents: the printer keeps it open, unless it's canceled or the client
+// doesn't come back in time. In that case it's closed with the documents it has.
+void TcpPrintServer::handleHeldClientSlot(int index) {
+  Printer* printer = printers[clientTargetPrinters[index]];
+  bool cancel = printer->isCancelRequested(index);
+  if (cancel || millis() - clientHeldSince[index] > JOB_TIMEOUT_MS) {
+    Serial.println(cancel ? "Job canceled" : "Job timed out waiting for a document");
+    if (!cancel) {
+      timeouts[TIMEOUT_NEXT_DOCUMENT]++;
+    }
+    endClientJob(index, cancel ? JOB_CANCELED : JOB_COMPLETED);
   }
 }
 
 void TcpPrintServer::start() {
-  socketServer.begin();
+  for (int i = 0; i < socketServerCount; i++) {
+    socketServers[i]->begin();
+  }
   ippServer.begin();
   httpServer.begin();
+  lastServiceMillis = millis() - SERVICE_INTERVAL_MS;
 }
 
-int TcpPrintServer::getFreeClientSlot() {
-  for (int i = 0; i < MAXCLIENTS; i++) {
-    if (clients[i] == NULL) {
-      return i;
+// Print-Job, Create-Job and Send-Document. Returns true if the connection was handed to a client
+// slot, to receive the document that follows.
+bool TcpPrintServer::handleIppJobRequest(IppStream* ippClient, int printerIndex) {
+  Printer* printer = printers[printerIndex];
+  if (ippClient->getOperationId() == IPP_SEND_DOCUMENT) {
+    Job* job = printer->getJobs().find(ippClient->getJobId()); //checked by parseRequest()
+    int index = job->clientId;
+    if (clients[index] != NULL) { //a Print-Job, or the previous document is still coming in
+      ippClient->sendErrorResponse(clientLastDocument[index] ? IPP_CLIENT_ERROR_NOT_POSSIBLE : IPP_SERVER_ERROR_BUSY);
+      return false;
+    } else if (!printer->startDocument(index, ippClient->getCompression())) {
+      ippClient->sendErrorResponse(IPP_CLIENT_ERROR_COMPRESSION_NOT_SUPPORTED);
+      return false;
     }
+    attachClient(index, ippClient, printerIndex, ippClient->isLastDocument());
+    setClientWatermarks(index);
+    ippClient->sendJobResponse(job->id);
+    return true;
   }
-  return -1;
+  int index = admission.acquire(printerIndex);
+  if (index == -1) { //parseRequest() checked, but the heap may have shrunk since
+    ippClient->sendErrorResponse(IPP_SERVER_ERROR_BUSY);
+    return false;
+  } else if (ippClient->getOperationId() == IPP_CREATE_JOB) {
+    clientTargetPrinters[index] = printerIndex;
+    holdClientSlot(index);
+    ippClient->sendJobResponse(printer->createJob(index, ippClient->getJobName(), ippClient->getJobPriority()));
+    return false;
+  }
+  // the Print-Job response carries the job id, so it's only sent once the job has started
+  ippClient->sendJobResponse(startClientJob(index, ippClient, printerIndex, ippClient->getJobName(), ippClient->getCompression(), ippClient->getJobPriority()));
+  return true;
 }
 
 void TcpPrintServer::processNewSocketClients() {
-  int freeClientSlot = getFreeClientSlot();
-  if (freeClientSlot != -1) {
-    WiFiClient newClient = socketServer.available();
-    if (newClient) {
-      Serial.println("Connected: " + newClient.remoteIP().toString() + ":" + newClient.remotePort());
-      clients[freeClientSlot] = new TcpStream(newClient);
-      clientTargetPrinters[freeClientSlot] = 0;
-      printers[0]->startJob(freeClientSlot);
+  // hasClient() only looks at the listener's queue, so idle listeners cost next to nothing; until
+  // its printer has a slot, a new connection waits in the listen backlog
+  for (int n = 0; n < socketServerCount; n++) {
+    int i = (nextSocketServer + n) % socketServerCount;
+    if (socketServers[i]->hasClient() && admission.canAdmit(i) && printers[i]->canAcceptJob()) {
+      WiFiClient newClient = socketServers[i]->available();
+      Serial.println("Connected: " + newClient.remoteIP().toString() + ":" + newClient.remotePort() + " for " + printers[i]->getName());
+      startClientJob(admission.acquire(i), socketStreams.acquire(newClient), i);
+      nextSocketServer = (i + 1) % socketServerCount;
+      return;
     }
   }
 }
 
 void TcpPrintServer::processNewIppClients() {
-  WiFiClient _ippClient = ippServer.available();
-  if (_ippClient) {
-    IppStream* ippClient = new IppStream(_ippClient);
-    int freeClientSlot = getFreeClientSlot();
-    int targetPrinterIndex = ippClient->parseRequest(printers, printerCount);
-    if (targetPrinterIndex != -1 && freeClientSlot != -1) {
-      clients[freeClientSlot] = ippClient;
-      clientTargetPrinters[freeClientSlot] = targetPrinterIndex;
-      printers[targetPrinterIndex]->startJob(freeClientSlot);
+  for (int i = 0; i < MAX_PENDING_CLIENTS; i++) {
+    if (pendingIppClients[i] == NULL) {
+      WiFiClient _ippClient = ippServer.available();
+      if (_ippClient) {
+        pendingIppClients[i] = ippStreams.acquire(_ippClient);
+        pendingIppSince[i] = millis();
+      }
+      return;
+    }
+  }
+}
+
+void TcpPrintServer::processPendingIppClients() {
+  for (int i = 0; i < MAX_PENDING_CLIENTS; i++) {
+    IppStream* ippClient = pendingIppClients[i];
+    if (ippClient == NULL) {
+      continue;
+    }
+    // every step takes only what has arrived, so a slow client never holds up the loop
+    int headStatus = ippClient->parseRequestHeader();
+    if (headStatus != HTTP_HEAD_COMPLETE) {
+      bool timedOut = millis() - pendingIppSince[i] > REQUEST_TIMEOUT_MS;
+      if (headStatus == HTTP_HEAD_ERROR || !ippClient->connected() || timedOut) {
+        if (timedOut) {
+          timeouts[TIMEOUT_REQUEST]++;
+        }
+        ippClient->close();
+        pendingIppClients[i] = NULL;
+      }
+      continue;
+    }
+    unsigned long startTime = micros();
+    int targetPrinterIndex = ippClient->parseRequest(printerRoutes, printers, attributeCaches, admission);
+    if (targetPrinterIndex == IPP_REQUEST_INCOMPLETE) {
+      if (millis() - pendingIppSince[i] > REQUEST_TIMEOUT_MS) {
+        Serial.println("IPP request timed out");
+        timeouts[TIMEOUT_REQUEST]++;
+        ippClient->close();
+        pendingIppClients[i] = NULL;
+      }
+      continue;
+    }
+    bool receivingDocument = targetPrinterIndex != -1 && handleIppJobRequest(ippClient, targetPrinterIndex);
+    ippClient->flushSendBuffer();
+    Serial.printf("IPP request handled in %lu us\r\n", micros() - startTime);
+    pendingIppClients[i] = NULL;
+    if (receivingDocument) {
+      continue;
+    } else if (ippClient->isKeepAlive() && ippClient->connected()) {
+      keepIppClientIdle(ippClient);
     } else {
-      delete ippClient;
+      ippClient->close();
+    }
+  }
+}
+
+// a persistent connection waits for its next request in an idle slot, or is closed if there's none
+void TcpPrintServer::keepIppClientIdle(IppStream* ippClient) {
+  ippClient->resetRequest();
+  for (int i = 0; i < MAX_IDLE_IPP_CLIENTS; i++) {
+    if (idleIppClients[i] == NULL) {
+      idleIppClients[i] = ippClient;
+      idleIppSince[i] = millis();
+      return;
+    }
+  }
+  ippClient->close();
+}
+
+// An idle connection goes back to a pending slot once its next request starts arriving, and the
+// request timeout runs from then.
+void TcpPrintServer::processIdleIppClients() {
+  for (int i = 0; i < MAX_IDLE_IPP_CLIENTS; i++) {
+    IppStream* ippClient = idleIppClients[i];
+    if (ippClient == NULL) {
+      continue;
+    }
+    if (ippClient->available() > 0) {
+      for (int j = 0; j < MAX_PENDING_CLIENTS; j++) {
+        if (pendingIppClients[j] == NULL) {
+          pendingIppClients[j] = ippClient;
+          pendingIppSince[j] = millis();
+          idleIppClients[i] = NULL;
+          break;
+        }
+      }
+    } else if (!ippClient->connected() || millis() - idleIppSince[i] > KEEP_ALIVE_TIMEOUT_MS) {
+      if (ippClient->connected()) {
+        timeouts[TIMEOUT_KEEP_ALIVE]++;
+      }
+      ippClient->close();
+      idleIppClients[i] = NULL;
     }
   }
 }
 
 void TcpPrintServer::processNewWebClients() {
-  WiFiClient _httpClient = httpServer.available();
-  if (!_httpClient) {
-    return;
+  if (!webClient.isOpen()) {
+    WiFiClient _httpClient = httpServer.available();
+    if (!_httpClient) {
+      return;
+    }
+    webClient.begin(_httpClient);
+    webFormLength = 0;
   }
-  unsigned long startTime = millis();
-  HttpStream newHttpClient(_httpClient);
-  if (!newHttpClient.parseRequestHeader()) {
+  int status = webClient.parseRequestHeader();
+  if (status == HTTP_HEAD_COMPLETE) {
+    webClient.sendContinueIfExpected();
+    status = webClient.readRequestBody(webForm, sizeof(webForm), webFormLength);
+  }
+  if (status == HTTP_HEAD_COMPLETE) {
+    handleWebClient(webClient);
+  } else if (status == HTTP_HEAD_INCOMPLETE && webClient.connected()) {
     return;
   }
-  String method = newHttpClient.getRequestMethod();
-  String path = newHttpClient.getRequestPath();
-  Serial.printf("request parsed: %s %s\r\n", method.c_str(), path.c_str());
-  if (method == "GET" && path == "/") {
-    newHttpClient.print("HTTP/1.1 200 OK \r\n\r\n<h1>ESP8266 print server</h1><a href=\"/wifi\">WiFi configuration</a><br><a href=\"/printerInfo\">Printers</a>");
-  } else if (method == "GET" && path == "/printerInfo") {
-    newHttpClient.print("HTTP/1.1 200 OK \r\n\r\n<h1>Available printers</h1>");
-    for (int i = 0; i < printerCount; i++) {
-      String name = printers[i]->getName();
-      String ip = WiFiManager::getIP();
-      newHttpClient.print("<h2>" + name + "</h2><p>" + printers[i]->getInfo() + "</p><p>Accessible at:</p><ul><li>ipp://" + ip + ":" + String(IPP_SERVER_PORT) + "/" + name + "</li>");
-      if (i == 0) {
-        newHttpClient.print("<li>socket://" + ip + ":" + SOCKET_SERVER_PORT + "</li>");
+  webClient.close();
+}
+
+void TcpPrintServer::handleWebClient(HttpStream& newHttpClient) {
+  unsigned long startTime = millis();
+  const char* method = newHttpClient.getRequestMethod();
+  const char* path = newHttpClient.getRequestPath();
+  Serial.printf("request parsed: %s %s\r\n", method, path);
+  switch (webRoutes.find(method, path)) {
+    case WEB_HOME:
+      newHttpClient.beginResponse(F("200 OK"), F("text/html"), false);
+      newHttpClient.print(F("<h1>ESP8266 print server</h1><a href=\"/wifi\">WiFi configuration</a><br><a href=\"/printerInfo\">Printers</a><br><a href=\"/metrics\">Metrics</a>"));
+      break;
+    case WEB_PRINTER_INFO:
+      newHttpClient.beginResponse(F("200 OK"), F("text/html"), false);
+      newHttpClient.print(F("<h1>Available printers</h1>"));
+      for (int i = 0; i < printerCount; i++) {
+        String name = printers[i]->getName();
+        String ip = WiFiManager::getIP();
+        newHttpClient.print("<h2>" + name + "</h2><p>" + printers[i]->getInfo() + "</p><p>Accessible at:</p><ul><li>ipp://" + ip + ":" + String(IPP_SERVER_PORT) + "/" + name + "</li>");
+        if (i < socketServerCount) {
+          newHttpClient.print("<li>socket://" + ip + ":" + String(SOCKET_SERVER_PORT + i) + "</li>");
+        }
+        newHttpClient.print(F("</ul>"));
       }
-      newHttpClient.print("</ul>");
-    }
-  } else if (method == "GET" && path == "/wifi") {
-    newHttpClient.print("HTTP/1.1 200 OK \r\n\r\n<h1>WiFi configuration</h1><p>Status: ");
-    newHttpClient.print(WiFiManager::info());
-    newHttpClient.print("</p><form method=\"POST\" action=\"/wifi-connect\">Available networks (choose one to connect):<ul>");
-    WiFiManager::getAvailableNetworks([&newHttpClient](String ssid, int encryption, int rssi) {
-      newHttpClient.print("<li><input type=\"radio\" name=\"SSID\" value=\"" + ssid + "\">" + ssid + " (" + WiFiManager::getEncryptionTypeName(encryption) + ", " + String(rssi) + " dBm)</li>");
-    });
-    newHttpClient.print("</ul>Password (leave blank for open networks): <input type=\"password\" name=\"password\"><input type=\"submit\" value=\"Connect\"></form>");
-  } else if (method == "POST" && path == "/wifi-connect") {
-    std::map<String, String> reqData = newHttpClient.parseUrlencodedRequestBody();
-    newHttpClient.print("HTTP/1.1 200 OK \r\n\r\n<h1>OK</h1>");
-    newHttpClient.flushSendBuffer();
-    WiFiManager::connectTo(reqData["SSID"].c_str(), reqData["password"]);
-  } else {
-    newHttpClient.print("HTTP/1.1 404 Not Found \r\n\r\n<h1>Not found</h1>");
+      break;
+    case WEB_WIFI:
+      newHttpClient.beginResponse(F("200 OK"), F("text/html"), false);
+      WiFiManager::refreshNetworks();
+      newHttpClient.print(F("<h1>WiFi configuration</h1><p>Status: "));
+      newHttpClient.print(WiFiManager::info());
+      newHttpClient.print(F("</p><form method=\"POST\" action=\"/wifi-connect\">Available networks (choose one to connect):<ul>"));
+      WiFiManager::getAvailableNetworks([&newHttpClient](String ssid, int encryption, int rssi) {
+        newHttpClient.print("<li><input type=\"radio\" name=\"SSID\" value=\"" + ssid + "\">" + ssid + " (" + WiFiManager::getEncryptionTypeName(encryption) + ", " + String(rssi) + " dBm)</li>");
+      });
+      newHttpClient.print(F("</ul>"));
+      newHttpClient.print(WiFiManager::scanInfo());
+      newHttpClient.print(F("<br>Password (leave blank for open networks): <input type=\"password\" name=\"password\"><input type=\"submit\" value=\"Connect\"></form>"));
+      break;
+    case WEB_WIFI_CONNECT: {
+      newHttpClient.beginResponse(F("200 OK"), F("text/html"), false);
+      newHttpClient.print(F("<h1>OK</h1>"));
+      newHttpClient.endResponse();
+      WiFiManager::connectTo(HttpStream::getFormValue(webForm, "SSID"), HttpStream::getFormValue(webForm, "password"));
+      break;
+    }
+    case WEB_METRICS:
+      newHttpClient.beginResponse(F("200 OK"), F("text/plain; version=0.0.4"), false);
+      sendMetrics(newHttpClient);
+      break;
+    case WEB_PROFILE: {
+      newHttpClient.beginResponse(F("200 OK"), F("text/plain"), false);
+      char line[96];
+      for (int i = 0; LoopProfiler::formatReportLine(i, line, sizeof(line)); i++) {
+        newHttpClient.print(line);
+      }
+      break;
+    }
+    default:
+      newHttpClient.beginResponse(F("404 Not Found"), F("text/html"), false);
+      newHttpClient.print(F("<h1>Not found</h1>"));
   }
+  newHttpClient.endResponse();
   Serial.println("HTTP client handled in " + String(millis() - startTime) + "ms");
 }
 
-void TcpPrintServer::process() {
+// one line of the Prometheus text format, formatted on the stack
+static void printMetric(HttpStream& client, const char* name, const char* labels, unsigned long value) {
+  char line[160];
+  snprintf(line, sizeof(line), labels[0] != '\0' ? "%s{%s} %lu\n" : "%s%s %lu\n", name, labels, value);
+  client.print(line);
+}
+
+static void printMetricType(HttpStream& client, const char* name, const char* type) {
+  char line[96];
+  snprintf(line, sizeof(line), "# TYPE %s %s\n", name, type);
+  client.print(line);
+}
+
+// The counters are plain fields bumped where things happen; only a scrape formats them.
+void TcpPrintServer::sendMetrics(HttpStream& client) {
+  char labels[64];
+  for (unsigned int m = 0; m < sizeof(printerMetrics) / sizeof(printerMetrics[0]); m++) {
+    printMetricType(client, printerMetrics[m].name, printerMetrics[m].type);
+    for (int i = 0; i < printerCount; i++) {
+      snprintf(labels, sizeof(labels), "printer=\"%s\"", printers[i]->getName().c_str());
+      printMetric(client, printerMetrics[m].name, labels, printerMetrics[m].value(printers[i]));
+    }
+  }
+  printMetricType(client, "printserver_connection_received_bytes", "gauge");
   for (int i = 0; i < MAXCLIENTS; i++) {
+    if (clients[i] != NULL) {
+      snprintf(labels, sizeof(labels), "slot=\"%d\",printer=\"%s\"", i, printers[clientTargetPrinters[i]]->getName().c_str());
+      printMetric(client, "printserver_connection_received_bytes", labels, clientReceivedBytes[i]);
+    }
+  }
+  printMetricType(client, "printserver_timeouts_total", "counter");
+  for (int i = 0; i < TIMEOUT_KIND_COUNT; i++) {
+    snprintf(labels, sizeof(labels), "kind=\"%s\"", timeoutNames[i]);
+    printMetric(client, "printserver_timeouts_total", labels, timeouts[i]);
+  }
+  printMetricType(client, "printserver_active_slots", "gauge");
+  printMetric(client, "printserver_active_slots", "", admission.usedSlots());
+  printMetricType(client, "printserver_slots", "gauge");
+  printMetric(client, "printserver_slots", "", MAXCLIENTS);
+  printMetricType(client, "printserver_free_heap_bytes", "gauge");
+  printMetric(client, "printserver_free_heap_bytes", "", ESP.getFreeHeap());
+  printMetricType(client, "printserver_largest_free_block_bytes", "gauge");
+  printMetric(client, "printserver_largest_free_block_bytes", "", ESP.getMaxFreeBlockSize());
+}
+
+void TcpPrintServer::process() {
+  uint32_t phaseStart = LoopProfiler::start();
+  for (int n = 0; n < MAXCLIENTS; n++) {
+    int i = (firstClient + n) % MAXCLIENTS;
     if (clients[i] != NULL) {
       handleClient(i);
     }
   }
+  firstClient = (firstClient + 1) % MAXCLIENTS;
+  LoopProfiler::end(PHASE_CLIENTS, phaseStart);
+  if (millis() - lastServiceMillis < SERVICE_INTERVAL_MS) {
+    return;
+  }
+  lastServiceMillis = millis();
+  phaseStart = LoopProfiler::start();
+  for (int i = 0; i < MAXCLIENTS; i++) {
+    if (clients[i] != NULL) {
+      reclaimStuckClient(i);
+    } else if (clientSlotHeld[i]) {
+      handleHeldClientSlot(i);
+    }
+  }
+  WiFiManager::processScan(hasActiveJobs());
+  LoopProfiler::end(PHASE_HOUSEKEEPING, phaseStart);
+  phaseStart = LoopProfiler::start();
   processNewSocketClients();
+  LoopProfiler::end(PHASE_NEW_SOCKET_CLIENTS, phaseStart);
+  phaseStart = LoopProfiler::start();
   processNewIppClients();
+  LoopProfiler::end(PHASE_NEW_IPP_CLIENTS, phaseStart);
+  phaseStart = LoopProfiler::start();
+  processIdleIppClients();
+  processPendingIppClients();
+  LoopProfiler::end(PHASE_PENDING_IPP_CLIENTS, phaseStart);
+  phaseStart = LoopProfiler::start();
   processNewWebClients();
+  LoopProfiler::end(PHASE_NEW_WEB_CLIENTS, phaseStart);
 }
 
-void TcpPrintServer::printInfo() {
-  int usedSlots = 0;
-  for (int i = 0; i < MAXCLIENTS; i++) {
-    if (clients[i] != NULL) {
-      usedSlots++;
+// jobs being received, or printed
+bool TcpPrintServer::hasActiveJobs() {
+  if (admission.usedSlots() > 0) {
+    return true;
+  }
+  for (int i = 0; i < printerCount; i++) {
+    if (printers[i]->getStatus() != IDLE) {
+      return true;
     }
   }
-  Serial.printf("Server slots: %d/%d\n", usedSlots, MAXCLIENTS);
+  return false;
+}
+
+void TcpPrintServer::printInfo() {
+  Serial.printf("Server slots: %d/%d\n", admission.usedSlots(), MAXCLIENTS);
+  Serial.printf("Connections: %d socket, %d IPP, I/O buffers: %d/%d\r\n", socketStreams.inUse(), ippStreams.inUse(), BufferPool::usedBuffers(), IO_BUFFER_COUNT);
+  for (int i = 0; i < printerCount; i++) {
+    Serial.printf("Printer %s: starved %lu ms, blocked %lu ms\r\n", printers[i]->getName().c_str(), printers[i]->getStarvedMillis(), printers[i]->getBlockedMillis());
+  }
 }
@@ -19,27 +19,105 @@
 #include <Arduino.h>
 #include <WiFiClient.h>
 #include <WiFiServer.h>
-#include <map>
 #include "Settings.h"
 #include "TcpStream.h"
+#include "HttpStream.h"
+#include "IppStream.h"
+#include "ConnectionPool.h"
 #include "Printer.h"
+#include "RequestRouter.h"
+#include "AdmissionController.h"
+#include "LoopProfiler.h"
+
+typedef enum {
+  WEB_HOME,
+  WEB_PRINTER_INFO,
+  WEB_WIFI,
+  WEB_WIFI_CONNECT,
+  WEB_METRICS,
+  WEB_PROFILE
+} web_endpoint;
+
+// why the server gave up waiting on a client, counted for /metrics
+typedef enum {
+  TIMEOUT_IDLE_CLIENT,
+  TIMEOUT_STALLED_JOB,
+  TIMEOUT_NEXT_DOCUMENT,
+  TIMEOUT_REQUEST,
+  TIMEOUT_KEEP_ALIVE, //an idle persistent connection closed, not a failure
+  TIMEOUT_KIND_COUNT
+} timeout_kind;
 
 class TcpPrintServer {
   private:
-    WiFiServer socketServer;
+    // one per printer that takes raw jobs, allocated at startup
+    WiFiServer* socketServers[MAX_SOCKET_SERVERS];
+    int socketServerCount;
+    // the listener checked first in the next round, so that they take turns
+    int nextSocketServer = 0;
     WiFiServer ippServer;
     WiFiServer httpServer;
+    // every connection object is created once, at startup
+    ConnectionPool<TcpStream, MAXCLIENTS> socketStreams;
+    ConnectionPool<IppStream, MAXCLIENTS + MAX_PENDING_CLIENTS + MAX_IDLE_IPP_CLIENTS> ippStreams;
+    HttpStream webClient;
+    // the request body of webClient, collected before it's handled
+    char webForm[WEB_FORM_MAX_LENGTH + 1];
+    size_t webFormLength = 0;
     TcpStream* clients[MAXCLIENTS];
     int clientTargetPrinters[MAXCLIENTS];
+    unsigned long clientLastPass[MAXCLIENTS];
+    // millis() when the client last sent something (or had data the printer couldn't take yet),
+    // and when data last moved: the idle and job deadlines run from these
+    unsigned long clientLastActivity[MAXCLIENTS];
+    unsigned long clientLastProgress[MAXCLIENTS];
+    // whether the document being received ends the job; a multi-document job keeps holding its
+    // slot between documents, for up to JOB_TIMEOUT_MS each time
+    bool clientLastDocument[MAXCLIENTS];
+    bool clientSlotHeld[MAXCLIENTS];
+    unsigned long clientHeldSince[MAXCLIENTS];
+    // bytes taken from the client's current connection
+    uint32_t clientReceivedBytes[MAXCLIENTS];
+    uint32_t timeouts[TIMEOUT_KIND_COUNT];
+    // the client served first in the next pass, so that they take turns
+    int firstClient = 0;
+    unsigned long lastServiceMillis = 0;
+    // accepted connections whose request hasn't fully arrived (or been answered) yet, and when
+    // they started waiting for it
+    IppStream* pendingIppClients[MAX_PENDING_CLIENTS];
+    unsigned long pendingIppSince[MAX_PENDING_CLIENTS];
+    // persistent connections waiting for their next request, apart so that they don't keep new
+    // clients out of the pending slots, and since when
+    IppStream* idleIppClients[MAX_IDLE_IPP_CLIENTS];
+    unsigned long idleIppSince[MAX_IDLE_IPP_CLIENTS];
     Printer** printers;
+    // one per printer, allocated at startup
+    IppAttributeCache* attributeCaches;
     int printerCount;
+    AdmissionController admission;
+    // built once in the constructor: the IPP printer paths and the web pages
+    RequestRouter printerRoutes;
+    RequestRouter webRoutes;
 
     void handleClient(int index);
+    void handleHeldClientSlot(int index);
+    void reclaimStuckClient(int index);
+    void endClientJob(int index, job_state state);
+    void attachClient(int index, TcpStream* client, int printerIndex, bool lastDocument);
+    void holdClientSlot(int index);
+    void setClientWatermarks(int index);
+    uint32_t startClientJob(int index, TcpStream* client, int printerIndex, const char* jobName = NULL, compression_type compression = COMPRESSION_NONE, byte priority = JOB_PRIORITY_DEFAULT);
+    bool handleIppJobRequest(IppStream* ippClient, int printerIndex);
 
-    int getFreeClientSlot();
     void processNewSocketClients();
     void processNewIppClients();
     void processNewWebClients();
+    void processPendingIppClients();
+    void keepIppClientIdle(IppStream* ippClient);
+    void processIdleIppClients();
+    void handleWebClient(HttpStream& client);
+    void sendMetrics(HttpStream& client);
+    bool hasActiveJobs();
   public:
     TcpPrintServer(Printer** _printers, int _printerCount);
     void start();
@@ -17,123 +17,290 @@
 
 #include "TcpStream.h"
 
-TcpStream::TcpStream(WiFiClient s): tcpConnection(s) {
+TcpStream::TcpStream() {
+}
+
+void TcpStream::begin(WiFiClient s) {
+  tcpConnection = s;
+  tcpConnection.setNoDelay(true); //writes are already coalesced into full segments, Nagle would only add latency
+  open = true;
   timedOut = false;
+  readDeadline = millis() + NETWORK_READ_TIMEOUT_MS;
+  sendBufferIndex = 0;
+  receiveBufferStart = 0;
+  receiveBufferCount = 0;
+  receivePaused = false;
+  setWatermarks(RECEIVE_HIGH_WATERMARK - 1, RECEIVE_HIGH_WATERMARK);
 }
 
-void TcpStream::waitAvailable(int numBytes) {
-  if (timedOut) {
+void TcpStream::close() {
+  if (!open) {
     return;
   }
-  unsigned long start = millis();
-  while (tcpConnection.available() < numBytes) {
-    delay(10);
-    if (millis() - start > NETWORK_READ_TIMEOUT_MS) {
-      timedOut = true;
-      handleTimeout();
+  flushSendBuffer();
+  Serial.println("Closing connection!");
+  tcpConnection.stop();
+  tcpConnection = WiFiClient();
+  BufferPool::release(sendBuffer);
+  sendBuffer = NULL;
+  sendBufferIndex = 0;
+  BufferPool::release(receiveBuffer);
+  receiveBuffer = NULL;
+  receiveBufferCount = 0;
+  open = false;
+}
+
+bool TcpStream::isOpen() {
+  return open;
+}
+
+void TcpStream::setWatermarks(int low, int high) {
+  receiveHighWatermark = constrain(high, 1, RECEIVE_BUFFER_SIZE);
+  receiveLowWatermark = constrain(low, 0, receiveHighWatermark - 1);
+}
+
+void TcpStream::fillReceiveBuffer() {
+  if (receivePaused) {
+    if (receiveBufferCount > receiveLowWatermark) {
+      return;
+    }
+    receivePaused = false;
+  }
+  if (receiveBuffer == NULL) {
+    if (tcpConnection.available() <= 0 || (receiveBuffer = BufferPool::acquire()) == NULL) {
+      return; //if the pool is exhausted the data stays in the socket and the TCP window does the rest
+    }
+    receiveBufferStart = 0;
+  }
+  // at most two socket reads: one up to the end of the ring, one for the wrapped-around part
+  for (int i = 0; i < 2 && receiveBufferCount < receiveHighWatermark; i++) {
+    int socketAvailable = tcpConnection.available();
+    if (socketAvailable <= 0) {
       return;
     }
+    int end = (receiveBufferStart + receiveBufferCount) % RECEIVE_BUFFER_SIZE;
+    int contiguousFree = min(receiveHighWatermark - receiveBufferCount, RECEIVE_BUFFER_SIZE - end);
+    int readCount = tcpConnection.read(receiveBuffer + end, min(contiguousFree, socketAvailable));
+    if (readCount <= 0) {
+      return;
+    }
+    receiveBufferCount += readCount;
+    readDeadline = millis() + NETWORK_READ_TIMEOUT_MS;
   }
+  receivePaused = receiveBufferCount >= receiveHighWatermark;
 }
 
-byte TcpStream::read() {
-  waitAvailable(1);
-  if (timedOut) {
-    return 0;
+void TcpStream::consumeReceivedBytes(int numBytes) {
+  receiveBufferStart = (receiveBufferStart + numBytes) % RECEIVE_BUFFER_SIZE;
+  receiveBufferCount -= numBytes;
+  if (receiveBufferCount == 0) {
+    BufferPool::release(receiveBuffer);
+    receiveBuffer = NULL;
   }
-  return tcpConnection.read();
 }
 
-uint16_t TcpStream::read2Bytes() {
-  waitAvailable(2);
-  if (timedOut) {
-    return 0;
+bool TcpStream::checkReadDeadline() {
+  if (!timedOut && (long) (millis() - readDeadline) >= 0) {
+    timedOut = true;
+    handleTimeout();
   }
-  uint16_t hi = read();
-  uint16_t lo = read();
-  return (hi << 8) | lo;
+  return !timedOut;
 }
 
-uint32_t TcpStream::read4Bytes() {
-  waitAvailable(4);
+bool TcpStream::ready(int numBytes) {
   if (timedOut) {
-    return 0;
+    return false;
+  }
+  fillReceiveBuffer();
+  if (receiveBufferCount >= numBytes) {
+    return true;
   }
-  uint32_t b0 = read();
-  uint32_t b1 = read();
-  uint32_t b2 = read();
-  uint32_t b3 = read();
-  return (b0 << 24) | (b1 << 16) | (b2 << 8) | b3;
+  checkReadDeadline();
+  return false;
 }
 
-String TcpStream::readStringUntil(char delim) {
+int TcpStream::available() {
   if (timedOut) {
-    return "";
+    return 0;
   }
-  String result = "";
-  result.reserve(16);
-  char c;
-  while (!timedOut && (c = read()) != delim) {
-    result += c;
+  fillReceiveBuffer();
+  return receiveBufferCount;
+}
+
+int TcpStream::peek() {
+  if (available() == 0) {
+    return -1;
   }
-  return timedOut ? "" : result;
+  return receiveBuffer[receiveBufferStart];
 }
 
-String TcpStream::readString(int len) {
-  waitAvailable(len);
-  if (timedOut) {
-    return "";
+size_t TcpStream::peekBuffered(const byte** data) {
+  if (available() == 0) {
+    return 0;
   }
-  String result = "";
-  result.reserve(len);
-  for (int i = 0; i < len; i++) {
-    result += (char) read();
+  *data = receiveBuffer + receiveBufferStart;
+  return min(receiveBufferCount, RECEIVE_BUFFER_SIZE - receiveBufferStart);
+}
+
+size_t TcpStream::readBytes(byte* buffer, size_t length) {
+  int count = min((int) length, available());
+  if (count == 0) {
+    return 0;
   }
-  return result;
+  int firstPart = min(count, RECEIVE_BUFFER_SIZE - receiveBufferStart);
+  memcpy(buffer, receiveBuffer + receiveBufferStart, firstPart);
+  memcpy(buffer + firstPart, receiveBuffer, count - firstPart);
+  consumeReceivedBytes(count);
+  return count;
+}
+
+size_t TcpStream::peekData(const byte** data) {
+  return peekBuffered(data);
+}
+
+void TcpStream::consumeData(size_t length) {
+  consumeReceivedBytes(length);
+}
+
+bool TcpStream::connected() {
+  return !timedOut && (receiveBufferCount > 0 || tcpConnection.connected());
 }
 
 bool TcpStream::hasMoreData() {
-  return !timedOut && tcpConnection.connected();
+  return connected();
 }
 
 bool TcpStream::dataAvailable() {
-  return !timedOut && tcpConnection.available() > 0;
+  return available() > 0;
+}
+
+bool TcpStream::hasTimedOut() {
+  return timedOut;
 }
 
 void TcpStream::write(byte b) {
-  if (timedOut) {
-    return;
-  }
-  sendBuffer[sendBufferIndex] = b;
-  sendBufferIndex++;
-  if (sendBufferIndex == SEND_BUFFER_SIZE) {
-    flushSendBuffer();
-  }
+  writeSpan(&b, 1, false);
 }
 
 void TcpStream::write2Bytes(uint16_t data) {
-  write((byte) ((data & 0xFF00) >> 8));
-  write((byte) (data & 0x00FF));
+  byte bytes[2] = {(byte) ((data & 0xFF00) >> 8), (byte) (data & 0x00FF)};
+  write(bytes, 2);
 }
 
 void TcpStream::write4Bytes(uint32_t data) {
-  write((byte) ((data & 0xFF000000) >> 24));
-  write((byte) ((data & 0x00FF0000) >> 16));
-  write((byte) ((data & 0x0000FF00) >> 8));
-  write((byte) (data & 0x000000FF));
+  byte bytes[4] = {
+    (byte) ((data & 0xFF000000) >> 24),
+    (byte) ((data & 0x00FF0000) >> 16),
+    (byte) ((data & 0x0000FF00) >> 8),
+    (byte) (data & 0x000000FF)
+  };
+  write(bytes, 4);
 }
 
-void TcpStream::print(String s) {
-  for (int i = 0; i < s.length(); i++) {
-    write((byte) s[i]);
+void TcpStream::writeUnbuffered(const byte* data, size_t length, bool inFlash) {
+  if (inFlash) {
+    tcpConnection.write_P((PGM_P) data, length);
+  } else {
+    tcpConnection.write(data, length);
+  }
+}
+
+void TcpStream::writeSpan(const byte* data, size_t length, bool inFlash) {
+  int sendBufferEnd = SEND_BUFFER_SIZE - sendTailroom;
+  while (!timedOut && length > 0) {
+    if (sendBuffer == NULL && length < (size_t) (sendBufferEnd - sendHeadroom)) {
+      sendBuffer = BufferPool::acquire();
+      sendBufferIndex = sendHeadroom;
+    }
+    if (sendBuffer == NULL) {
+      // a whole segment or more, or no buffer to spare: no point in copying it
+      writeUnbuffered(data, length, inFlash);
+      return;
+    }
+    size_t copyLength = min(length, (size_t) (sendBufferEnd - sendBufferIndex));
+    if (inFlash) {
+      memcpy_P(sendBuffer + sendBufferIndex, data, copyLength);
+    } else {
+      memcpy(sendBuffer + sendBufferIndex, data, copyLength);
+    }
+    sendBufferIndex += copyLength;
+    data += copyLength;
+    length -= copyLength;
+    if (sendBufferIndex == sendBufferEnd) {
+      flushSendBuffer();
+    }
   }
 }
 
+void TcpStream::write(const byte* data, size_t length) {
+  writeSpan(data, length, false);
+}
+
+void TcpStream::write_P(PGM_P data, size_t length) {
+  writeSpan((const byte*) data, length, true);
+}
+
+// Without a send buffer (none is held, and the pool is exhausted) the spans would each go out in
+// their own write, and segment. They're gathered on the stack instead: only a span too big for it
+// is written on its own.
+void TcpStream::writeSpans(const SendSpan* spans, int count) {
+  if (sendBuffer == NULL && (sendBuffer = BufferPool::acquire()) != NULL) {
+    sendBufferIndex = sendHeadroom;
+  }
+  if (sendBuffer != NULL) {
+    for (int i = 0; i < count; i++) {
+      writeSpan(spans[i].data, spans[i].length, spans[i].inFlash);
+    }
+    return;
+  }
+  byte gathered[SEND_STACK_BUFFER_SIZE];
+  size_t gatheredLength = 0;
+  for (int i = 0; i < count && !timedOut; i++) {
+    const SendSpan& span = spans[i];
+    if (gatheredLength + span.length > sizeof(gathered) && gatheredLength > 0) {
+      writeUnbuffered(gathered, gatheredLength, false);
+      gatheredLength = 0;
+    }
+    if (span.length > sizeof(gathered)) {
+      writeUnbuffered(span.data, span.length, span.inFlash);
+    } else if (span.inFlash) {
+      memcpy_P(gathered + gatheredLength, span.data, span.length);
+      gatheredLength += span.length;
+    } else {
+      memcpy(gathered + gatheredLength, span.data, span.length);
+      gatheredLength += span.length;
+    }
+  }
+  if (gatheredLength > 0 && !timedOut) {
+    writeUnbuffered(gathered, gatheredLength, false);
+  }
+}
+
+void TcpStream::print(const char* s) {
+  write((const byte*) s, strlen(s));
+}
+
+void TcpStream::print(const __FlashStringHelper* s) {
+  PGM_P p = reinterpret_cast<PGM_P>(s);
+  write_P(p, strlen_P(p));
+}
+
+void TcpStream::print(const String& s) {
+  write((const byte*) s.c_str(), s.length());
+}
+
 void TcpStream::flushSendBuffer() {
-  if (!timedOut) {
+  if (!timedOut && sendBufferIndex > 0) {
     tcpConnection.write((byte*)sendBuffer, sendBufferIndex);
-    sendBufferIndex = 0;
   }
+  sendBufferIndex = 0;
+  BufferPool::release(sendBuffer);
+  sendBuffer = NULL;
+}
+
+void TcpStream::failConnection() {
+  timedOut = true;
+  tcpConnection.stop();
 }
 
 void TcpStream::handleTimeout() {
@@ -142,8 +309,6 @@ void TcpStream::handleTimeout() {
 }
 
 TcpStream::~TcpStream() {
-  flushSendBuffer();
-  Serial.println("Closing connection!");
-  tcpConnection.stop();
+  close();
 }
 
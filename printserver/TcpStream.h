@@ -19,37 +19,93 @@
 #include <Arduino.h>
 #include <WiFiClient.h>
 #include "Settings.h"
+#include "BufferPool.h"
 
-#define SEND_BUFFER_SIZE 1024
+#define SEND_BUFFER_SIZE IO_BUFFER_SIZE
+#define RECEIVE_BUFFER_SIZE IO_BUFFER_SIZE
+// writeSpans() gathers small spans on the stack, up to this much, when the pool has no send buffer
+#define SEND_STACK_BUFFER_SIZE 256
+
+// A fragment of outgoing data owned by the caller; inFlash marks PROGMEM data
+typedef struct {
+  const byte* data;
+  size_t length;
+  bool inFlash;
+} SendSpan;
 
 class TcpStream {
   private:
     WiFiClient tcpConnection;
+    bool open = false;
     bool timedOut = false;
-    byte sendBuffer[SEND_BUFFER_SIZE];
-    int sendBufferIndex = 0;
-    void waitAvailable(int numBytes);
+    unsigned long readDeadline;
+    // ring buffer filled from the socket in large chunks; peek() and readBytes() are served from here;
+    // like sendBuffer it is borrowed from BufferPool only while it holds data
+    byte* receiveBuffer = NULL;
+    int receiveBufferStart = 0;
+    int receiveBufferCount = 0;
+    int receiveLowWatermark = RECEIVE_HIGH_WATERMARK - 1;
+    int receiveHighWatermark = RECEIVE_HIGH_WATERMARK;
+    bool receivePaused = false;
+    void fillReceiveBuffer();
+    bool checkReadDeadline();
+    void writeSpan(const byte* data, size_t length, bool inFlash);
 
   protected:
+    byte* sendBuffer = NULL;
+    int sendBufferIndex = 0;
+    // bytes kept free at the start and at the end of every send buffer, for framing added by subclasses at flush time
+    int sendHeadroom = 0;
+    int sendTailroom = 0;
+
     virtual void handleTimeout();
+    // drops the connection on a protocol error: from then on it reads as ended, like a timed out one
+    void failConnection();
+    // writes data that doesn't go through sendBuffer straight to the socket
+    virtual void writeUnbuffered(const byte* data, size_t length, bool inFlash);
+    // zero-copy access for parsers: the longest contiguous run of buffered bytes, valid until consumed
+    size_t peekBuffered(const byte** data);
+    void consumeReceivedBytes(int numBytes);
 
   public:
-    TcpStream(WiFiClient _tcpConnection);
+    TcpStream();
+    // streams are pooled: begin() attaches a freshly accepted connection, close() gives the object back
+    virtual void begin(WiFiClient _tcpConnection);
+    virtual void close();
+    bool isOpen();
+    // once high bytes are buffered the socket isn't read again until they're consumed down to low
+    void setWatermarks(int low, int high);
 
+    bool connected();
     virtual bool hasMoreData();
     virtual bool dataAvailable();
+    bool hasTimedOut();
+
+    // Non-blocking readiness check: never waits, but pulls whatever the socket has into the
+    // receive buffer and fails the connection once the read deadline has passed without progress.
+    bool ready(int numBytes);
 
-    virtual byte read();
-    uint16_t read2Bytes();
-    uint32_t read4Bytes();
-    String readStringUntil(char delim);
-    String readString(int length);
+    virtual int available();
+    int peek();
+    // copies up to length buffered bytes without waiting; 0 means the read would block
+    virtual size_t readBytes(byte* buffer, size_t length);
+    // zero-copy reads: the longest contiguous run of data readable without waiting (valid until
+    // consumed), then how much of it was used
+    virtual size_t peekData(const byte** data);
+    virtual void consumeData(size_t length);
 
     void write(byte b);
     void write2Bytes(uint16_t data);
     void write4Bytes(uint32_t data);
-    void print(String s);
-    void flushSendBuffer();
+    // Gather writes: small fragments are coalesced into sendBuffer, anything left over that is at
+    // least as big as the buffer is handed to the socket directly from the caller's memory.
+    void write(const byte* data, size_t length);
+    void write_P(PGM_P data, size_t length);
+    void writeSpans(const SendSpan* spans, int count);
+    void print(const char* s);
+    void print(const __FlashStringHelper* s);
+    void print(const String& s);
+    virtual void flushSendBuffer();
 
-    ~TcpStream();
+    virtual ~TcpStream();
 };
@@ -22,6 +22,12 @@
 #define CONNECTION_TIMEOUT_MS 10*1000
 
 bool WiFiManager::apEnabled = false;
+ScannedNetwork WiFiManager::networks[WIFI_SCAN_CACHE_SIZE];
+int WiFiManager::networkCount = 0;
+bool WiFiManager::scanned = false;
+unsigned long WiFiManager::scanTime = 0;
+bool WiFiManager::scanRequested = true;
+bool WiFiManager::scanRunning = false;
 
 void WiFiManager::wifi_setup() {
   Serial.println("Connecting to WiFi...");
@@ -56,6 +62,16 @@ String WiFiManager::info() {
   }
 }
 
+IPAddress WiFiManager::getIPAddress() {
+  if (apEnabled) {
+    return WiFi.softAPIP();
+  } else if (WiFi.status() == WL_CONNECTED) {
+    return WiFi.localIP();
+  } else {
+    return IPAddress();
+  }
+}
+
 String WiFiManager::getIP() {
   if (apEnabled) {
     return WiFi.softAPIP().toString();
@@ -79,11 +95,51 @@ char* WiFiManager::getEncryptionTypeName(int t) {
 }
 
 void WiFiManager::getAvailableNetworks(std::function<void(String, int, int)> forEachNet) {
-  int count = WiFi.scanNetworks();
-  for (int i = 0; i < count; i++) {
-    forEachNet(WiFi.SSID(i), WiFi.encryptionType(i),  WiFi.RSSI(i));
+  for (int i = 0; i < networkCount; i++) {
+    forEachNet(networks[i].ssid, networks[i].encryption, networks[i].rssi);
+  }
+}
+
+void WiFiManager::refreshNetworks() {
+  if (!scanned || millis() - scanTime > WIFI_SCAN_MAX_AGE_MS) {
+    scanRequested = true;
+  }
+}
+
+String WiFiManager::scanInfo() {
+  if (scanRunning) {
+    return "Scanning for networks, reload the page in a few seconds";
+  } else if (scanRequested) {
+    return "Scan for networks queued, it waits for running print jobs; reload the page in a few seconds";
+  }
+  return "Networks found " + String((millis() - scanTime) / 1000) + " s ago";
+}
+
+void WiFiManager::processScan(bool jobsActive) {
+  if (scanRunning) {
+    int count = WiFi.scanComplete();
+    if (count == WIFI_SCAN_RUNNING) {
+      return;
+    }
+    scanRunning = false;
+    if (count < 0) {
+      Serial.println("WiFi scan failed");
+      return;
+    }
+    networkCount = min(count, WIFI_SCAN_CACHE_SIZE);
+    for (int i = 0; i < networkCount; i++) {
+      strncpy(networks[i].ssid, WiFi.SSID(i).c_str(), sizeof(networks[i].ssid) - 1);
+      networks[i].ssid[sizeof(networks[i].ssid) - 1] = '\0';
+      networks[i].encryption = WiFi.encryptionType(i);
+      networks[i].rssi = WiFi.RSSI(i);
+    }
+    WiFi.scanDelete();
+    scanned = true;
+    scanTime = millis();
+  } else if (scanRequested && !jobsActive) {
+    scanRequested = false;
+    scanRunning = WiFi.scanNetworks(true) == WIFI_SCAN_RUNNING;
   }
-  WiFi.scanDelete();
 }
 
 void WiFiManager::connectTo(String ssid, String password) {
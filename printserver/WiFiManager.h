@@ -18,15 +18,38 @@
 #pragma once
 #include <Arduino.h>
 #include <functional>
+#include "Settings.h"
+
+struct ScannedNetwork {
+  char ssid[33];
+  byte encryption;
+  int8_t rssi;
+};
 
 class WiFiManager {
   private:
     static bool apEnabled;
+    // results of the last scan, and millis() when it completed
+    static ScannedNetwork networks[WIFI_SCAN_CACHE_SIZE];
+    static int networkCount;
+    static bool scanned;
+    static unsigned long scanTime;
+    static bool scanRequested;
+    static bool scanRunning;
   public:
     static void wifi_setup();
     static String info();
     static String getIP();
+    // 0 while offline
+    static IPAddress getIPAddress();
     static char* getEncryptionTypeName(int i);
+    // the networks found by the last scan; never waits for a scan
     static void getAvailableNetworks(std::function<void(String, int, int)> forEachNet);
+    // asks for a new scan if the cached networks are stale
+    static void refreshNetworks();
+    static String scanInfo();
+    // Runs the scans in the background: starts a requested one unless print jobs are active (the
+    // radio leaves the channel while scanning), and picks up the results once it's done.
+    static void processScan(bool jobsActive);
     static void connectTo(String ssid, String password);
 };
@@ -28,6 +28,7 @@
 #include "SerialPortPrinter.h"
 #include "USBPortPrinter.h"
 #include "PrintQueue.h"
+#include "LoopProfiler.h"
 
 /*#define STROBE 10
 #define BUSY 9
@@ -64,15 +65,21 @@ void setup() {
   Serial.println("initialized printers");
   WiFiManager::wifi_setup();
   server.start();
+  LoopProfiler::calibrate();
   Serial.println("setup ok");
 }
 
 void loop() {
+  uint32_t loopStart = LoopProfiler::start();
   printDebugAndYield();
+  LoopProfiler::end(PHASE_DEBUG, loopStart);
   server.process();
+  uint32_t queueStart = LoopProfiler::start();
   for (unsigned int i = 0; i < PRINTER_COUNT; i++) {
     printers[i]->processQueue();
   }
+  LoopProfiler::end(PHASE_QUEUE, queueStart);
+  LoopProfiler::end(PHASE_LOOP, loopStart);
 }
 
 inline void printDebugAndYield() {
@@ -88,6 +95,15 @@ inline void printDebugAndYield() {
     PrintQueue::updateAvailableFlashSpace();
     yield();
 
+    static unsigned long lastProfileReport = 0;
+    if (millis() - lastProfileReport > LOOP_PROFILER_REPORT_MS) {
+      char line[96];
+      for (int i = 0; LoopProfiler::formatReportLine(i, line, sizeof(line)); i++) {
+        Serial.print(line);
+      }
+      lastProfileReport = millis();
+    }
+
     lastCall = millis();
   }
 }
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Builds and runs one of the host benchmarks, bench_<name>.cpp, against a source tree (by default
+# the one next to this directory), e.g. a checkout of an older commit to compare with:
+#   ./bench.sh sched /tmp/old/printserver
+T=$(cd "$(dirname "$0")" && pwd)
+name=bench_$1
+R=${2:-$T/../printserver}
+mkdir -p "$T/build" && cd "$T/build" || exit 1
+SRC=""
+# the printer ports only for the benchmark that simulates their devices
+[ "$1" = backends ] && SRC="$R/SerialPortPrinter.cpp $R/USBPortPrinter.cpp $R/ParallelPortPrinter.cpp $R/DirectParallelPortPrinter.cpp $R/ShiftRegParallelPortPrinter.cpp"
+for f in HttpStream TcpStream BufferPool RequestRouter AdmissionController IppStream IppAttributeCache Printer PrintQueue JobTable Inflater LoopProfiler TcpPrintServer; do
+  [ -f "$R/$f.cpp" ] && SRC="$SRC $R/$f.cpp"
+done
+FLAGS=""
+grep -q getIPAddress "$R/WiFiManager.h" || FLAGS="$FLAGS -DWIFI_MANAGER_BEFORE_IP_ADDRESS"
+grep -q processScan "$R/WiFiManager.h" || FLAGS="$FLAGS -DWIFI_MANAGER_BEFORE_SCAN_CACHE"
+g++ -std=gnu++11 -O2 $FLAGS -I"$T/mock" -I"$R" -include Arduino.h "$T/mock/mock.cpp" "$T/mock/netmock.cpp" "$T/mock/fsmock.cpp" "$T/mock/wifistub.cpp" "$T/$name.cpp" $SRC -o $name || exit 1
+./$name
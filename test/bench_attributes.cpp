@@ -0,0 +1,54 @@
+// the loop time it takes to answer a Get-Printer-Attributes request for all the attributes, through
+// TcpPrintServer, and how many socket writes the response takes
+#include "TcpPrintServer.h"
+#include "netmock.h"
+#include <cassert>
+#include <chrono>
+extern size_t mockChunk;
+struct P: Printer { P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte b) {} String getInfo() {return "";} };
+static void attr(std::string& b, byte tag, const std::string& name, const std::string& value) {
+  b += (char) tag; b += (char) (name.size() >> 8); b += (char) name.size(); b += name;
+  b += (char) (value.size() >> 8); b += (char) value.size(); b += value;
+}
+int main() {
+  mockChunk = 1460;
+  std::string body = std::string("\x01\x01\x00\x0B\x00\x00\x00\x07\x01", 9);
+  attr(body, 0x47, "attributes-charset", "utf-8");
+  attr(body, 0x48, "attributes-natural-language", "en-us");
+  attr(body, 0x44, "requested-attributes", "all");
+  body += "\x03";
+  char head[128]; snprintf(head, sizeof head, "POST /usb HTTP/1.1\r\nContent-Length: %zu\r\n\r\n", body.size());
+  P usb("usb"); usb.init();
+  Printer* printers[] = {&usb};
+  TcpPrintServer server(printers, 1);
+  server.start();
+  const int requests = 2000;
+  size_t bytes = 0, writes = 0;
+  double total = 0;
+  for (int i = 0; i < requests; i++) {
+    int s = mockConnect(IPP_SERVER_PORT, head + body);
+    // The time spent in the loop passes from the one that read the request to the one that completed
+    // the response (once it stops growing for a few passes): the wait for the listener's turn and
+    // the polling interval aren't counted.
+    size_t size = 0; int still = 0;
+    double spent = 0, answered = 0;
+    while (still < 20) {
+      auto start = std::chrono::steady_clock::now();
+      server.process();
+      if (mockSockets[s].pos > 0) {
+        spent += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+      }
+      if (mockSockets[s].output.size() != size) {
+        size = mockSockets[s].output.size(); still = 0;
+        answered = spent;
+      } else if (size > 0) {
+        still++;
+      }
+    }
+    assert(mockSockets[s].output.find("printer-state") != std::string::npos);
+    total += answered; bytes += size; writes += mockSockets[s].writeCalls;
+    mockSockets[s].connected = false;
+    for (int j = 0; j < 5; j++) server.process(); //lets the server drop the connection
+  }
+  printf("Get-Printer-Attributes (all): %.1f us to respond, %zu bytes in %.1f socket writes\n", total / requests, bytes / requests, (double) writes / requests);
+}
@@ -0,0 +1,58 @@
+// throughput of each printer port backend, fed by socket jobs through TcpPrintServer; the
+// simulated devices take every byte instantly, so this measures the software path alone
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "SerialPortPrinter.h"
+#include "USBPortPrinter.h"
+#include "DirectParallelPortPrinter.h"
+#include "ShiftRegParallelPortPrinter.h"
+#include "netmock.h"
+#include <cassert>
+#include <chrono>
+extern size_t mockChunk;
+static size_t sunk = 0;
+// the device ends of the ports
+struct Sink: Stream { size_t write(uint8_t) override { sunk++; return 1; } size_t write(const uint8_t*, size_t n) override { sunk += n; return n; } int availableForWrite() override { return 128; } int available() override { return 0; } int read() override { return -1; } int peek() override { return -1; } };
+CH375::CH375(Stream&, int) {} bool CH375::init() { return true; } bool CH375::setBaudRate(long, std::function<void()> f) { f(); return true; }
+CH375USBPrinter::CH375USBPrinter(CH375&) {} bool CH375USBPrinter::init() { return true; } size_t CH375USBPrinter::write(uint8_t) { sunk++; return 1; } void CH375USBPrinter::flush() {}
+SoftwareSerial::SoftwareSerial(int, int, bool, int) {} void SoftwareSerial::begin(long) {} size_t SoftwareSerial::write(uint8_t) { return 1; }
+int SoftwareSerial::available() { return 0; } int SoftwareSerial::read() { return -1; } int SoftwareSerial::peek() { return -1; }
+// parallel ports: count strobes (HIGH after LOW on the strobe pin)
+#define STROBE_PIN 10
+extern void (*mockDigitalWrite)(int, int);
+static void countStrobes(int pin, int value) { if (pin == STROBE_PIN && value == HIGH) sunk++; }
+
+static double run(Printer* printer, size_t jobSize, int jobs) {
+  Printer* printers[] = {printer};
+  TcpPrintServer server(printers, 1);
+  server.start();
+  sunk = 0;
+  for (int j = 0; j < jobs; j++) mockConnect(SOCKET_SERVER_PORT, std::string(jobSize, 'a' + j));
+  auto t0 = std::chrono::steady_clock::now();
+  while (sunk < jobSize * jobs) { server.process(); printer->processQueue(); }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  assert(sunk == jobSize * jobs);
+  for (int i = 0; i < 20; i++) { server.process(); printer->processQueue(); } //let the jobs finish
+  return jobSize * jobs / s / 1e6;
+}
+int main() {
+  mockChunk = 1460;
+  setvbuf(stdout, NULL, _IONBF, 0);
+  mockDigitalWrite = countStrobes;
+  Sink sink;
+  SerialPortPrinter serial("serial", &sink);
+  SoftwareSerial ch375serial(1, 2, false, 32);
+  USBPortPrinter usb("usb", ch375serial, 3);
+  int dataPins[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+  DirectParallelPortPrinter direct("lpt", dataPins, STROBE_PIN, 9);
+  ShiftRegParallelPortPrinter shiftReg("shiftreg", 11, 12, 13, STROBE_PIN, 9);
+  Printer* backends[] = {&serial, &usb, &direct, &shiftReg};
+  const char* names[] = {"SerialPortPrinter", "USBPortPrinter", "DirectParallelPortPrinter", "ShiftRegParallelPortPrinter"};
+  for (int i = 0; i < 4; i++) {
+    backends[i]->init();
+    double directRate = run(backends[i], 4 << 20, 1);
+    double spooledRate = run(backends[i], 384 << 10, 2); //the second job is spooled (within the 1 MB of simulated flash), then printed from the queue
+    printf("%-28s direct %6.1f MB/s, direct + spooled %6.1f MB/s\n", names[i], directRate, spooledRate);
+  }
+  puts("ok");
+}
@@ -0,0 +1,51 @@
+// throughput of a 4 MB job sent as a chunked IPP Print-Job, the way CUPS sends it, against the same
+// bytes sent raw over AppSocket, to a printer that takes every byte at once
+#include "TcpPrintServer.h"
+#include "netmock.h"
+#include <cassert>
+#include <chrono>
+extern size_t mockChunk;
+struct P: Printer { size_t printed = 0; P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte b) { printed++; } String getInfo() {return "";} };
+static void attr(std::string& b, byte tag, const std::string& name, const std::string& value) {
+  b += (char) tag; b += (char) (name.size() >> 8); b += (char) name.size(); b += name;
+  b += (char) (value.size() >> 8); b += (char) value.size(); b += value;
+}
+static std::string chunked(const std::string& body, size_t chunkSize) {
+  std::string result;
+  for (size_t i = 0; i < body.size(); i += chunkSize) {
+    size_t length = std::min(chunkSize, body.size() - i);
+    char line[16]; snprintf(line, sizeof line, "%zx\r\n", length);
+    result += line + body.substr(i, length) + "\r\n";
+  }
+  return result + "0\r\n\r\n";
+}
+static double run(int port, const std::string& data, size_t size) {
+  mockSockets.clear();
+  P usb("usb"); usb.init();
+  Printer* printers[] = {&usb};
+  TcpPrintServer server(printers, 1);
+  server.start();
+  mockConnect(port, data);
+  auto start = std::chrono::steady_clock::now();
+  while (usb.printed < size) {
+    server.process(); usb.processQueue();
+    assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(60));
+  }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return size / s / 1e6;
+}
+int main() {
+  mockChunk = 1460;
+  const size_t size = 4 << 20;
+  std::string document(size, 'p');
+  printf("AppSocket raw: %.1f MB/s\n", run(SOCKET_SERVER_PORT, document, size));
+  std::string body = std::string("\x01\x01\x00\x02\x00\x00\x00\x07\x01", 9);
+  attr(body, 0x47, "attributes-charset", "utf-8");
+  attr(body, 0x48, "attributes-natural-language", "en-us");
+  body += "\x03" + document;
+  // CUPS 2.x writes the document in chunks of its 32 KB buffer; small ones show the per-chunk cost
+  for (size_t chunkSize : {32768, 512}) {
+    std::string head = "POST /usb HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+    printf("IPP chunked, %zu-byte chunks: %.1f MB/s\n", chunkSize, run(IPP_SERVER_PORT, head + chunked(body, chunkSize), size));
+  }
+}
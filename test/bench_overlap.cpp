@@ -0,0 +1,32 @@
+// how long the client of a second job stays connected while another job holds the printer, with
+// flash writes costing simulated time
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+extern size_t mockChunk;
+extern unsigned long mockFlashCallUs, mockFlashByteNs;
+struct P: Printer { size_t printed = 0; bool ready = false; P(const char* n): Printer(n) {} bool canPrint() { return ready; } void printByte(byte) { printed++; } String getInfo() {return "";} };
+int main() {
+  mockChunk = 1460;
+  // SPIFFS on the ESP8266, roughly: a fixed cost per write call and ~80 KB/s
+  mockFlashCallUs = 150; mockFlashByteNs = 12000;
+  size_t sizes[] = {512, 3000, 16384, 65536};
+  for (size_t size : sizes) {
+    P printer("usb"); printer.init();
+    Printer* printers[] = {&printer};
+    TcpPrintServer server(printers, 1);
+    server.start();
+    int first = mockConnect(SOCKET_SERVER_PORT, "first", true);
+    for (int i = 0; i < 10; i++) { server.process(); printer.processQueue(); mockClockOffsetUs += 100; }
+    int second = mockConnect(SOCKET_SERVER_PORT, std::string(size, 's'));
+    unsigned long long start = mockNowUs();
+    while (!mockSockets[second].stopped) { server.process(); printer.processQueue(); mockClockOffsetUs += 100; }
+    printf("second job %6zu bytes: connected %8.1f ms\n", size, (mockNowUs() - start) / 1000.0);
+    mockSockets[first].connected = false; printer.ready = true;
+    for (int i = 0; i < 2000 && printer.printed < size + 5; i++) { server.process(); printer.processQueue(); mockClockOffsetUs += 100; }
+    assert(printer.printed == size + 5);
+    PrintQueue::updateAvailableFlashSpace();
+  }
+  puts("ok");
+}
@@ -0,0 +1,65 @@
+// job completion times on a synthetic mixed workload: a 20 kB/s printer, jobs arriving about every
+// 0.8 s (85% load), 12% of them 96 kB reports, the rest small, a third of those urgent
+#include "Printer.h"
+#include <vector>
+#include <algorithm>
+extern unsigned long long mockClockOffsetUs;
+// every job's bytes are its number, and the printer counts them: the job table forgets old jobs
+static size_t printedOf[256];
+struct P: Printer { int budget = 0; P(): Printer("usb") {} bool canPrint() { return budget > 0; } void printByte(byte b) { budget--; printedOf[b]++; } String getInfo() {return "";} };
+struct Sub { unsigned long arrival; size_t size; byte priority; int kind; int slot = -1; size_t sent = 0; uint32_t id = 0; long done = -1; };
+static uint32_t seed = 12345;
+static uint32_t rnd(uint32_t n) { seed = seed * 1103515245 + 12345; return (seed >> 8) % n; }
+static void report(const char* name, std::vector<long> t) {
+  std::sort(t.begin(), t.end());
+  double mean = 0; for (long x : t) mean += x; mean /= t.size();
+  printf("%-7s %3zu jobs: mean %6.1f s, p95 %6.1f s\n", name, t.size(), mean / 1000, t[(t.size() * 95 + 99) / 100 - 1] / 1000.0);
+}
+int main() {
+  P p; p.init();
+  std::vector<Sub> subs;
+  unsigned long at = 1000;
+  for (int i = 0; i < 250; i++) {
+    Sub s; at += rnd(1600); s.arrival = at;
+    int r = rnd(100);
+    if (r < 12) { s.kind = 0; s.size = 96 * 1024; s.priority = 50; }
+    else if (r < 70) { s.kind = 1; s.size = 1024 + rnd(3072); s.priority = 50; }
+    else { s.kind = 2; s.size = 512 + rnd(1536); s.priority = 80; }
+    subs.push_back(s);
+  }
+  std::vector<std::string> data;
+  for (size_t i = 0; i < subs.size(); i++) data.push_back(std::string(subs[i].size, (char) i));
+  bool slots[MAXCLIENTS] = {};
+  unsigned long start = millis();
+  size_t next = 0, finished = 0;
+  while (finished < subs.size()) {
+    unsigned long now = millis() - start;
+    for (; next < subs.size() && subs[next].arrival <= now; next++) {}
+    for (size_t i = 0; i < next; i++) {
+      Sub& s = subs[i];
+      if (s.slot == -1 && s.id == 0) {
+        for (int c = 0; c < MAXCLIENTS; c++) if (!slots[c]) { slots[c] = true; s.slot = c; break; }
+        if (s.slot == -1) continue;
+#ifdef JOB_PRIORITY_DEFAULT
+        s.id = p.startJob(s.slot, NULL, COMPRESSION_NONE, s.priority);
+#else
+        s.id = p.startJob(s.slot, NULL, COMPRESSION_NONE);
+#endif
+      }
+      if (s.slot != -1) {
+        size_t n = std::min((size_t) 1460, s.size - s.sent);
+        s.sent += p.write(s.slot, (const byte*) data[i].data() + s.sent, n);
+        if (s.sent == s.size) { p.endJob(s.slot, JOB_COMPLETED); slots[s.slot] = false; s.slot = -1; }
+      }
+      if (s.done == -1 && printedOf[i] == s.size) { s.done = now - s.arrival; finished++; }
+    }
+    if (now / 1000 != (now + SERVICE_INTERVAL_MS) / 1000) PrintQueue::updateAvailableFlashSpace(); //as the main loop does
+    if (getenv("TRACE") && now % 10000 < SERVICE_INTERVAL_MS) fprintf(stderr, "%lu: next %zu finished %zu status %d queued %d\n", now, next, finished, p.getStatus(), p.getQueuedJobCount());
+    p.budget = 100;
+    p.processQueue();
+    mockClockOffsetUs += SERVICE_INTERVAL_MS * 1000;
+  }
+  std::vector<long> all, kinds[3];
+  for (Sub& s : subs) { all.push_back(s.done); kinds[s.kind].push_back(s.done); }
+  report("all", all); report("reports", kinds[0]); report("small", kinds[1]); report("urgent", kinds[2]);
+}
@@ -0,0 +1,45 @@
+// throughput of a multi-MB IPP Print-Job, from the socket through TcpPrintServer to a printer that
+// takes every byte at once, with the network handing over a TCP segment per read; the request is
+// chunked in 32 KB chunks, the way CUPS sends it
+#include "TcpPrintServer.h"
+#include "netmock.h"
+#include <cassert>
+#include <chrono>
+extern size_t mockChunk;
+struct P: Printer { size_t printed = 0; P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte b) { printed++; } String getInfo() {return "";} };
+static void attr(std::string& b, byte tag, const std::string& name, const std::string& value) {
+  b += (char) tag; b += (char) (name.size() >> 8); b += (char) name.size(); b += name;
+  b += (char) (value.size() >> 8); b += (char) value.size(); b += value;
+}
+static std::string chunked(const std::string& body, size_t chunkSize) {
+  std::string result;
+  for (size_t i = 0; i < body.size(); i += chunkSize) {
+    size_t length = std::min(chunkSize, body.size() - i);
+    char line[16]; snprintf(line, sizeof line, "%zx\r\n", length);
+    result += line + body.substr(i, length) + "\r\n";
+  }
+  return result + "0\r\n\r\n";
+}
+int main() {
+  mockChunk = 1460;
+  for (size_t size : {1 << 20, 4 << 20}) {
+    std::string body = std::string("\x01\x01\x00\x02\x00\x00\x00\x07\x01", 9);
+    attr(body, 0x47, "attributes-charset", "utf-8");
+    attr(body, 0x48, "attributes-natural-language", "en-us");
+    body += "\x03" + std::string(size, 'p');
+    std::string head = "POST /usb HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+    mockSockets.clear();
+    P usb("usb"); usb.init();
+    Printer* printers[] = {&usb};
+    TcpPrintServer server(printers, 1);
+    server.start();
+    mockConnect(IPP_SERVER_PORT, head + chunked(body, 32768));
+    auto start = std::chrono::steady_clock::now();
+    while (usb.printed < size) {
+      server.process(); usb.processQueue();
+      assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(60));
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Print-Job of %zu MB: %.1f MB/s\n", size >> 20, size / s / 1e6);
+  }
+}
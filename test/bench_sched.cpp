@@ -0,0 +1,47 @@
+// host benchmark: the main loop of printserver.ino, with N socket jobs arriving at once
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <algorithm>
+extern size_t mockChunk;
+extern std::map<std::string, std::string> mockFiles;
+struct P: Printer { std::string out; P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte b) { out += (char) b; } String getInfo() {return "";} };
+int main(int argc, char** argv) {
+  mockChunk = 1460;
+  const size_t size = 100000;
+  for (int jobs = 1; jobs <= 4; jobs++) {
+    mockSockets.clear(); mockFiles.clear();
+    P usb("usb"), serial("serial"); usb.init(); serial.init();
+    Printer* printers[] = {&usb, &serial};
+    TcpPrintServer server(printers, 2);
+    server.start();
+    std::string expected;
+    for (int j = 0; j < jobs; j++) { std::string data(size, (char) ('a' + j)); mockConnect(SOCKET_SERVER_PORT, data); }
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+    std::vector<double> received(jobs, 0);
+    long passes = 0;
+    while (true) {
+      server.process();
+      usb.processQueue(); serial.processQueue();
+      passes++;
+      bool done = usb.getStatus() == IDLE && usb.getQueuedJobCount() == 0;
+      for (int j = 0; j < (int) mockSockets.size(); j++) {
+        if (received[j] == 0 && mockSockets[j].pos == size) received[j] = elapsed();
+        done = done && mockSockets[j].stopped;
+      }
+      if (done || elapsed() > 120) break;
+    }
+    double total = elapsed();
+    assert(usb.out.size() == jobs * size);
+    for (int j = 0; j < jobs; j++) assert(std::count(usb.out.begin(), usb.out.end(), (char) ('a' + j)) == (long) size);
+    double first = 1e9, last = 0; for (double r: received) { first = std::min(first, r); last = std::max(last, r); }
+    printf("%d job(s) of %zu bytes: printer %.0f kB/s sustained (%.1f ms, %ld passes); all received after %.1f ms, first after %.1f ms\n",
+      jobs, size, jobs * size / total / 1000, total * 1000, passes, last * 1000, first * 1000);
+  }
+  puts("ok");
+}
@@ -0,0 +1,44 @@
+// host benchmark: worst-case loop latency while an IPP client trickles its request in, one byte at a time
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+#include <chrono>
+#include <map>
+extern size_t mockChunk;
+struct P: Printer { size_t printed = 0; P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte b) { printed++; } String getInfo() {return "";} };
+static void attr(std::string& b, byte tag, const std::string& name, const std::string& value) {
+  b += (char) tag; b += (char) (name.size() >> 8); b += (char) name.size(); b += name;
+  b += (char) (value.size() >> 8); b += (char) value.size(); b += value;
+}
+int main() {
+  mockChunk = 1460;
+  std::string body = std::string("\x01\x01\x00\x0B\x00\x00\x00\x07\x01", 9);
+  attr(body, 0x47, "attributes-charset", "utf-8");
+  attr(body, 0x48, "attributes-natural-language", "en-us");
+  attr(body, 0x44, "requested-attributes", "printer-state");
+  body += "\x03";
+  char head[128]; snprintf(head, sizeof head, "POST /usb HTTP/1.1\r\nContent-Length: %zu\r\n\r\n", body.size());
+  std::string request = head + body;
+  for (unsigned long long trickleUs : {1000ULL, 10000ULL}) {
+    mockSockets.clear();
+    P usb("usb"), serial("serial"); usb.init(); serial.init();
+    Printer* printers[] = {&usb, &serial};
+    TcpPrintServer server(printers, 2);
+    server.start();
+    int job = mockConnect(SOCKET_SERVER_PORT, std::string(4000000, 'j'));
+    int slow = mockConnect(IPP_SERVER_PORT, request, true);
+    mockSockets[slow].trickleUs = trickleUs;
+    double worst = 0; long passes = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while (mockSockets[slow].output.find("printer-state") == std::string::npos || !mockSockets[job].stopped) {
+      auto start = std::chrono::steady_clock::now();
+      server.process(); usb.processQueue(); serial.processQueue();
+      worst = std::max(worst, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+      passes++;
+      assert(std::chrono::steady_clock::now() - begin < std::chrono::seconds(30));
+    }
+    printf("request of %zu bytes at one byte per %llu ms, 4 MB job alongside: worst loop pass %.2f ms over %ld passes\n", request.size(), trickleUs / 1000, worst, passes);
+  }
+  puts("ok");
+}
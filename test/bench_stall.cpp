@@ -0,0 +1,31 @@
+// how long an AppSocket job takes with a half-open IPP client connected alongside, which sent part
+// of its request head and then nothing
+#include "TcpPrintServer.h"
+#include "netmock.h"
+#include <chrono>
+extern size_t mockChunk;
+struct P: Printer { size_t printed = 0; P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte b) { printed++; } String getInfo() {return "";} };
+int main() {
+  mockChunk = 1460;
+  const size_t size = 1 << 20;
+  for (bool stalled : {false, true}) {
+    mockSockets.clear();
+    P usb("usb"); usb.init();
+    Printer* printers[] = {&usb};
+    TcpPrintServer server(printers, 1);
+    server.start();
+    if (stalled) {
+      mockConnect(IPP_SERVER_PORT, "POST /usb HTTP/1.1\r\nContent-", true);
+    }
+    mockConnect(SOCKET_SERVER_PORT, std::string(size, 's'));
+    double worst = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while (usb.printed < size) {
+      auto start = std::chrono::steady_clock::now();
+      server.process(); usb.processQueue();
+      worst = std::max(worst, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    double total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    printf("1 MB AppSocket job%s: done in %.1f ms, worst loop pass %.2f ms\n", stalled ? " beside a stalled IPP client" : "", total, worst);
+  }
+}
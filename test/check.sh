@@ -0,0 +1,12 @@
+#!/bin/sh
+# Compiles every source file of the sketch (the .ino as C++, with the prototypes the Arduino
+# builder would generate) against the mocks with -Wall, without linking
+T=$(cd "$(dirname "$0")" && pwd)
+R=${R:-$T/../printserver}
+mkdir -p "$T/build" && cd "$R" || exit 1
+{ grep -h '^#include' printserver.ino; grep -E '^[A-Za-z].*\) \{$' printserver.ino | sed -e 's/ {$/;/' -e 's/^inline //'; cat printserver.ino; } > "$T/build/printserver_ino.cpp"
+status=0
+for f in *.cpp "$T/build/printserver_ino.cpp"; do
+  g++ -std=gnu++11 -fsyntax-only -Wall -Wno-unused-variable -Wno-write-strings -I"$T/mock" -I. -include Arduino.h "$f" || status=1
+done
+exit $status
@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+# writes the documents t_inflate and t_gzipjob decompress: each one raw, as zlib and raw deflate
+# streams at several levels, as gzip, and as gzip with every optional header field
+import os, random, struct, sys, zlib
+
+out = sys.argv[1] if len(sys.argv) > 1 else "inf"
+os.makedirs(out, exist_ok=True)
+rng = random.Random(1)
+raster = bytearray(400000)
+for row in range(0, len(raster), 400):
+    for start in rng.sample(range(0, 400, 40), 2):
+        raster[row + start:row + start + 40] = bytes(rng.getrandbits(8) for _ in range(40))
+documents = {
+    "empty": b"",
+    "small": b"a",
+    "text": b"".join(b"line %d of the document, hello hello hello\n" % i for i in range(5000)),
+    "random": bytes(rng.getrandbits(8) for _ in range(70000)),
+    "raster": bytes(raster),
+}
+
+def deflate(data, level, wbits):
+    c = zlib.compressobj(level, zlib.DEFLATED, wbits)
+    return c.compress(data) + c.flush()
+
+def write(name, data):
+    with open(os.path.join(out, name), "wb") as f:
+        f.write(data)
+
+for base, data in documents.items():
+    write(base + ".raw", data)
+    for level in (0, 1, 6, 9):
+        write("%s.%d.zlib" % (base, level), deflate(data, level, 15))
+        write("%s.%d.deflate" % (base, level), deflate(data, level, -15))
+    trailer = struct.pack("<II", zlib.crc32(data), len(data))
+    body = deflate(data, 6, -15) + trailer
+    write(base + ".gz", b"\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03" + body)
+    # FHCRC, FEXTRA, FNAME and FCOMMENT
+    write(base + ".fancy.gz", b"\x1f\x8b\x08\x1e\x00\x00\x00\x00\x00\x03" + b"\x03\x00xyz" + b"name.pcl\x00" + b"comment\x00" + b"\x12\x34" + body)
@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string>
+#include <functional>
+#include <algorithm>
+using std::min; using std::max;
+#define constrain(a, l, h) ((a) < (l) ? (l) : ((a) > (h) ? (h) : (a)))
+typedef uint8_t byte;
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper*>(p))
+inline void* memcpy_P(void* d, const void* s, size_t n) { return memcpy(d, s, n); }
+inline size_t strlen_P(const char* s) { return strlen(s); }
+inline int strncmp_P(const char* a, const char* b, size_t n) { return strncmp(a, b, n); }
+inline int strcmp_P(const char* a, const char* b) { return strcmp(a, b); }
+inline int strncasecmp_P(const char* a, const char* b, size_t n) { return strncasecmp(a, b, n); }
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_ptr(p) (*(void* const*)(p))
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define MSBFIRST 1
+#define bitRead(v, b) (((v) >> (b)) & 1)
+#define D0 0
+#define D1 1
+#define D2 2
+#define D3 3
+#define D4 4
+#define D5 5
+#define D6 6
+#define D7 7
+#define TCP_MSS 1460
+unsigned long millis(); unsigned long micros(); void delay(unsigned long); void delayMicroseconds(unsigned int); void yield();
+void pinMode(int, int); void digitalWrite(int, int); int digitalRead(int); void shiftOut(int, int, int, byte);
+class String {
+ public:
+  std::string s;
+  String() {} String(const char* c) : s(c ? c : "") {} String(const std::string& x) : s(x) {}
+  String(const __FlashStringHelper* c) : s((const char*)c) {}
+  String(char c) : s(1, c) {}
+  String(int v) : s(std::to_string(v)) {} String(unsigned int v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {} String(unsigned long v) : s(std::to_string(v)) {}
+  String(int v, int base) { char b[34]; snprintf(b, sizeof b, base == 16 ? "%x" : "%d", v); s = b; }
+  unsigned int length() const { return s.size(); }
+  const char* c_str() const { return s.c_str(); }
+  char operator[](unsigned int i) const { return s[i]; }
+  char& operator[](unsigned int i) { return s[i]; }
+  bool reserve(unsigned int n) { s.reserve(n); return true; }
+  void toLowerCase() { for (char& c : s) c = tolower(c); }
+  bool startsWith(const String& p) const { return s.compare(0, p.s.size(), p.s) == 0; }
+  bool endsWith(const String& p) const { return s.size() >= p.s.size() && s.compare(s.size() - p.s.size(), p.s.size(), p.s) == 0; }
+  String substring(unsigned int a) const { return s.substr(a); }
+  String substring(unsigned int a, unsigned int b) const { return s.substr(a, b - a); }
+  long toInt() const { return atol(s.c_str()); }
+  bool operator==(const String& o) const { return s == o.s; } bool operator!=(const String& o) const { return s != o.s; }
+  bool operator==(const char* o) const { return s == o; } bool operator!=(const char* o) const { return s != o; }
+  bool operator<(const String& o) const { return s < o.s; }
+  String& operator+=(const String& o) { s += o.s; return *this; } String& operator+=(const char* o) { s += o; return *this; }
+  String& operator+=(char c) { s += c; return *this; }
+  String& operator+=(int c) { s += std::to_string(c); return *this; }
+  bool concat(const char* c, unsigned int n) { s.append(c, n); return true; }
+  friend String operator+(const String& a, const String& b) { return a.s + b.s; }
+  friend String operator+(const char* a, const String& b) { return a + b.s; }
+  friend String operator+(const String& a, const char* b) { return a.s + b; }
+  friend String operator+(const String& a, int b) { return a.s + std::to_string(b); }
+  friend String operator+(const String& a, unsigned long b) { return a.s + std::to_string(b); }
+  friend String operator+(const String& a, uint16_t b) { return a.s + std::to_string(b); }
+  friend String operator+(const String& a, char b) { return a.s + b; }
+};
+class Print {
+ public:
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* b, size_t n) { size_t i = 0; for (; i < n; i++) write(b[i]); return i; }
+  virtual int availableForWrite() { return 0; }
+  size_t print(const String&); size_t print(const char*); size_t print(int); size_t println(const String&); size_t println(const char*); size_t println();
+  size_t print(const __FlashStringHelper*); size_t println(const __FlashStringHelper*);
+  size_t printf(const char*, ...);
+  size_t printf_P(PGM_P, ...);
+};
+class Stream : public Print {
+ public:
+  virtual int available() = 0; virtual int read() = 0; virtual int peek() = 0;
+};
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long); size_t write(uint8_t) override; int available() override; int read() override; int peek() override;
+  int availableForWrite() override;
+};
+extern HardwareSerial Serial;
+class IPAddress { public: uint32_t addr = 0; IPAddress() {} operator uint32_t() const { return addr; } String toString() const; };
+struct EspClass { uint32_t getFreeHeap(); uint32_t getChipId(); uint32_t getCycleCount(); uint32_t getCpuFreqMHz(); uint16_t getMaxFreeBlockSize(); uint8_t getHeapFragmentation(); };
+extern EspClass ESP;
@@ -0,0 +1,3 @@
+#pragma once
+#include <Arduino.h>
+class CH375 { public: CH375(Stream&, int); bool init(); bool setBaudRate(long, std::function<void()>); };
@@ -0,0 +1,3 @@
+#pragma once
+#include <CH375.h>
+class CH375USBPrinter : public Print { public: CH375USBPrinter(CH375&); bool init(); size_t write(uint8_t) override; void flush(); };
@@ -0,0 +1,11 @@
+#pragma once
+#include <WiFiClient.h>
+#include <WiFiServer.h>
+enum { ENC_TYPE_WEP, ENC_TYPE_TKIP, ENC_TYPE_CCMP, ENC_TYPE_NONE, ENC_TYPE_AUTO };
+#define WL_CONNECTED 3
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+struct WiFiClass { void setAutoConnect(bool); void setAutoReconnect(bool); bool isConnected(); bool softAP(const char*); IPAddress softAPIP(); IPAddress localIP();
+  int status(); String SSID(); String SSID(int); int32_t RSSI(); int32_t RSSI(int); uint8_t encryptionType(int); int8_t scanNetworks(bool async = false); int8_t scanComplete(); void scanDelete();
+  bool softAPdisconnect(bool); int begin(const char*, const char*); };
+extern WiFiClass WiFi;
@@ -0,0 +1,10 @@
+#pragma once
+#include <Arduino.h>
+#include <string>
+struct FSInfo { size_t totalBytes, usedBytes, blockSize, pageSize, maxOpenFiles, maxPathLength; };
+class File : public Stream { public: size_t write(uint8_t) override; size_t write(const uint8_t*, size_t) override; int available() override; int read() override; int peek() override;
+  size_t read(uint8_t*, size_t); const char* name() const; void close(); operator bool() const; size_t size() const; size_t position() const; bool seek(uint32_t);
+  std::string path; size_t pos = 0; bool isOpen = false; };
+class Dir { public: bool next(); String fileName(); size_t fileSize(); File openFile(const char*); std::string prefix, current; bool started = false; };
+struct FS { bool begin(); File open(const String&, const char*); bool exists(const String&); bool remove(const String&); bool rename(const String&, const String&); bool info(FSInfo&); Dir openDir(const String&); };
+extern FS SPIFFS;
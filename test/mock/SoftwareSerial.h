@@ -0,0 +1,3 @@
+#pragma once
+#include <Arduino.h>
+class SoftwareSerial : public Stream { public: SoftwareSerial(int, int, bool, int); void begin(long); size_t write(uint8_t) override; int available() override; int read() override; int peek() override; };
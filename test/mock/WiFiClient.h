@@ -0,0 +1,10 @@
+#pragma once
+#include <Arduino.h>
+class WiFiClient : public Stream {
+ public:
+  WiFiClient(); int available() override; int read() override; int read(uint8_t*, size_t); int peek() override;
+  size_t write(uint8_t) override; size_t write(const uint8_t*, size_t) override; size_t write_P(PGM_P, size_t);
+  void stop(); uint8_t connected(); operator bool(); IPAddress remoteIP(); uint16_t remotePort();
+  void setNoDelay(bool); int availableForWrite() override; void flush();
+  int socket = -1; //netmock.cpp: an entry of mockSockets; -1 is the global mock connection
+};
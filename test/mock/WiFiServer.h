@@ -0,0 +1,3 @@
+#pragma once
+#include <WiFiClient.h>
+class WiFiServer { public: WiFiServer(uint16_t); void begin(); WiFiClient available(); bool hasClient(); void setNoDelay(bool); uint16_t port; };
@@ -0,0 +1,48 @@
+#include <FS.h>
+#include <map>
+#include <vector>
+std::map<std::string, std::string> mockFiles;
+// every write call (file, offset, length), and what a write costs in simulated time
+struct MockFlashWrite { std::string path; size_t offset, length; };
+std::vector<MockFlashWrite> mockFlashWrites;
+unsigned long mockFlashCallUs = 0, mockFlashByteNs = 0;
+extern unsigned long long mockClockOffsetUs;
+static void logWrite(const std::string& path, size_t offset, size_t n) {
+  if (n == 0) return;
+  mockFlashWrites.push_back({path, offset, n});
+  mockClockOffsetUs += mockFlashCallUs + n * mockFlashByteNs / 1000;
+}
+size_t File::write(uint8_t b) { if (!isOpen) return 0; logWrite(path, mockFiles[path].size(), 1); mockFiles[path] += (char) b; return 1; }
+size_t File::write(const uint8_t* b, size_t n) { if (!isOpen) return 0; logWrite(path, mockFiles[path].size(), n); mockFiles[path].append((const char*) b, n); return n; }
+int File::available() { return isOpen && mockFiles.count(path) ? mockFiles[path].size() - pos : 0; }
+int File::read() { return available() > 0 ? (byte) mockFiles[path][pos++] : -1; }
+int File::peek() { return available() > 0 ? (byte) mockFiles[path][pos] : -1; }
+size_t File::read(uint8_t* b, size_t n) { n = std::min(n, (size_t) available()); if (n) memcpy(b, mockFiles[path].data() + pos, n); pos += n; return n; }
+const char* File::name() const { return path.c_str(); }
+void File::close() { isOpen = false; }
+File::operator bool() const { return isOpen; }
+size_t File::size() const { return mockFiles.count(path) ? mockFiles.at(path).size() : 0; }
+size_t File::position() const { return pos; }
+bool File::seek(uint32_t p) { pos = p; return true; }
+bool FS::begin() { return true; }
+File FS::open(const String& p, const char* mode) {
+  File f; f.path = p.c_str();
+  if (mode[0] == 'r' && !mockFiles.count(f.path)) return f;
+  if (mode[0] == 'w') mockFiles[f.path] = "";
+  if (mode[0] == 'a') mockFiles[f.path];
+  f.isOpen = true; return f;
+}
+bool FS::exists(const String& p) { return mockFiles.count(p.c_str()) > 0; }
+bool FS::remove(const String& p) { return mockFiles.erase(p.c_str()) > 0; }
+bool FS::rename(const String& a, const String& b) { if (!mockFiles.count(a.c_str())) return false; mockFiles[b.c_str()] = mockFiles[a.c_str()]; mockFiles.erase(a.c_str()); return true; }
+bool FS::info(FSInfo& i) { i.totalBytes = 1000000; i.usedBytes = 0; i.blockSize = 8192; i.pageSize = 256; return true; }
+Dir FS::openDir(const String& p) { Dir d; d.prefix = p.c_str(); return d; }
+bool Dir::next() {
+  auto it = started ? mockFiles.upper_bound(current) : mockFiles.lower_bound(prefix);
+  started = true;
+  if (it == mockFiles.end() || it->first.compare(0, prefix.size(), prefix) != 0) return false;
+  current = it->first; return true;
+}
+String Dir::fileName() { return String(current.c_str()); }
+size_t Dir::fileSize() { return mockFiles.count(current) ? mockFiles[current].size() : 0; }
+File Dir::openFile(const char* mode) { return SPIFFS.open(String(current.c_str()), mode); }
@@ -0,0 +1,48 @@
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiServer.h>
+#include <ESP8266WiFi.h>
+#include <FS.h>
+#include <stdarg.h>
+#include <string>
+#include <deque>
+#include <sys/time.h>
+// mock socket: a global input queue, delivered in chunks of mockChunk bytes
+std::string mockInput; size_t mockPos = 0; size_t mockChunk = 7; std::string mockOutput; bool mockConnected = true;
+unsigned long long mockClockOffsetUs = 0; //to fast-forward time
+static unsigned long long nowUs() { struct timeval tv; gettimeofday(&tv, 0); return tv.tv_sec * 1000000ULL + tv.tv_usec + mockClockOffsetUs; }
+static unsigned long long startUs = nowUs();
+unsigned long millis() { return (nowUs() - startUs) / 1000; }
+unsigned long micros() { return nowUs() - startUs; }
+void delay(unsigned long) {} void delayMicroseconds(unsigned int) {} void yield() {}
+void pinMode(int, int) {} void (*mockDigitalWrite)(int, int) = 0; void digitalWrite(int p, int v) { if (mockDigitalWrite) mockDigitalWrite(p, v); } int digitalRead(int) { return 0; } void shiftOut(int, int, int, byte) {}
+HardwareSerial Serial; EspClass ESP; WiFiClass WiFi; FS SPIFFS;
+size_t Print::print(const String& s) { return 0; } size_t Print::print(const char*) { return 0; } size_t Print::print(int) { return 0; }
+size_t Print::println(const String& s) { return 0; } size_t Print::println(const char* s) { return 0; } size_t Print::println() { return 0; }
+size_t Print::print(const __FlashStringHelper*) { return 0; } size_t Print::println(const __FlashStringHelper*) { return 0; }
+size_t Print::printf(const char* f, ...) { return 0; } size_t Print::printf_P(PGM_P f, ...) { return 0; }
+void HardwareSerial::begin(unsigned long) {} size_t HardwareSerial::write(uint8_t) { return 1; } int HardwareSerial::available() { return 0; }
+int HardwareSerial::read() { return -1; } int HardwareSerial::peek() { return -1; } int HardwareSerial::availableForWrite() { return 64; }
+// per connection mock sockets (netmock.cpp), or the global one
+#include "netmock.h"
+std::deque<MockSocket> mockSockets;
+#define SOCK(field, global) (socket >= 0 ? mockSockets[socket].field : global)
+size_t MockSocket::sent() const { return trickleUs == 0 ? input.size() : std::min(input.size(), (size_t) ((nowUs() - connectedAtUs) / trickleUs)); }
+WiFiClient::WiFiClient() {}
+int WiFiClient::available() { return std::min(mockChunk, (socket >= 0 ? mockSockets[socket].sent() : mockInput.size()) - SOCK(pos, mockPos)); }
+int WiFiClient::read() { std::string& in = SOCK(input, mockInput); size_t& pos = SOCK(pos, mockPos); return pos < in.size() ? (byte) in[pos++] : -1; }
+int WiFiClient::read(uint8_t* b, size_t n) { n = std::min(n, (size_t) available()); memcpy(b, SOCK(input, mockInput).data() + SOCK(pos, mockPos), n); SOCK(pos, mockPos) += n; return n; }
+int WiFiClient::peek() { return -1; }
+size_t mockWriteCalls = 0; //the global socket's
+static void countWrite(int socket) { if (socket >= 0) mockSockets[socket].writeCalls++; else mockWriteCalls++; }
+size_t WiFiClient::write(uint8_t b) { countWrite(socket); SOCK(output, mockOutput) += (char) b; return 1; }
+size_t WiFiClient::write(const uint8_t* b, size_t n) { countWrite(socket); SOCK(output, mockOutput).append((const char*) b, n); return n; }
+size_t WiFiClient::write_P(PGM_P b, size_t n) { countWrite(socket); SOCK(output, mockOutput).append(b, n); return n; }
+void WiFiClient::stop() { if (socket >= 0) mockSockets[socket].stopped = true; }
+uint8_t WiFiClient::connected() { return SOCK(connected, mockConnected) || SOCK(pos, mockPos) < SOCK(input, mockInput).size(); }
+unsigned long long mockNowUs() { return nowUs(); } WiFiClient::operator bool() { return socket != -2; }
+IPAddress WiFiClient::remoteIP() { return IPAddress(); } uint16_t WiFiClient::remotePort() { return 0; } void WiFiClient::setNoDelay(bool) {}
+int WiFiClient::availableForWrite() { return 1460; } void WiFiClient::flush() {}
+String IPAddress::toString() const { return "192.168.1.2"; }
+uint32_t EspClass::getFreeHeap() { return 40000; } uint32_t EspClass::getChipId() { return 1; } uint32_t EspClass::getCycleCount() { return micros() * 80; }
+uint32_t EspClass::getCpuFreqMHz() { return 80; } uint16_t mockMaxFreeBlock = 36000; uint16_t EspClass::getMaxFreeBlockSize() { return mockMaxFreeBlock; } uint8_t EspClass::getHeapFragmentation() { return 0; }
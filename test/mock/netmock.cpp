@@ -0,0 +1,18 @@
+#include <WiFiServer.h>
+#include <map>
+#include "netmock.h"
+static std::map<uint16_t, std::deque<int>> pending;
+WiFiServer::WiFiServer(uint16_t p) : port(p) {}
+void WiFiServer::begin() {}
+void WiFiServer::setNoDelay(bool) {}
+bool WiFiServer::hasClient() { return !pending[port].empty(); }
+WiFiClient WiFiServer::available() {
+  WiFiClient c; c.socket = -2;
+  if (!pending[port].empty()) { c.socket = pending[port].front(); pending[port].pop_front(); }
+  return c;
+}
+int mockConnect(uint16_t port, const std::string& data, bool keepOpen) {
+  mockSockets.emplace_back(); mockSockets.back().input = data; mockSockets.back().connected = keepOpen; mockSockets.back().connectedAtUs = mockNowUs();
+  pending[port].push_back(mockSockets.size() - 1);
+  return mockSockets.size() - 1;
+}
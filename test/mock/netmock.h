@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <stdint.h>
+// trickleUs: the peer sends one byte every trickleUs microseconds after connecting (0: all at once)
+struct MockSocket { std::string input; size_t pos = 0; std::string output; bool connected = true; bool stopped = false; unsigned long long trickleUs = 0, connectedAtUs = 0;
+  size_t writeCalls = 0; //WiFiClient::write() calls
+  size_t sent() const; };
+extern std::deque<MockSocket> mockSockets;
+// queues a connection to the port with the given data, closed by the peer once it's read
+int mockConnect(uint16_t port, const std::string& data, bool keepOpen = false);
+extern unsigned long long mockClockOffsetUs;
+unsigned long long mockNowUs();
@@ -0,0 +1,21 @@
+// WiFiManager for the tests that don't exercise it: fixed answers, no radio. bench.sh builds
+// older trees too, whose WiFiManager lacks the later functions.
+#include "WiFiManager.h"
+uint32_t mockIPAddress = 0x0200000A; //10.0.0.2, first octet in the low byte like lwIP
+String WiFiManager::getIP() {
+  char text[16]; snprintf(text, sizeof text, "%u.%u.%u.%u", mockIPAddress & 0xFF, (mockIPAddress >> 8) & 0xFF, (mockIPAddress >> 16) & 0xFF, mockIPAddress >> 24);
+  return text;
+}
+#ifndef WIFI_MANAGER_BEFORE_IP_ADDRESS
+IPAddress WiFiManager::getIPAddress() { IPAddress address; address.addr = mockIPAddress; return address; }
+#endif
+String WiFiManager::info() { return ""; }
+char* WiFiManager::getEncryptionTypeName(int) { return (char*) ""; }
+void WiFiManager::getAvailableNetworks(std::function<void(String, int, int)>) {}
+String mockWifiSsid, mockWifiPassword; //the last connectTo()
+void WiFiManager::connectTo(String ssid, String password) { mockWifiSsid = ssid; mockWifiPassword = password; }
+#ifndef WIFI_MANAGER_BEFORE_SCAN_CACHE
+void WiFiManager::refreshNetworks() {}
+String WiFiManager::scanInfo() { return ""; }
+void WiFiManager::processScan(bool) {}
+#endif
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Builds and runs the host tests: the sketch's sources compiled with g++ against the mocks in
+# mock/, which stand in for the ESP8266 core, the network and SPIFFS. R overrides the tree tested.
+T=$(cd "$(dirname "$0")" && pwd)
+R=${R:-$T/../printserver}
+mkdir -p "$T/build" && cd "$T/build" || exit 1
+[ -d inf ] || python3 "$T/make_inflate_data.py" inf || exit 1
+MOCK="$T/mock/mock.cpp"
+NET="$T/mock/netmock.cpp $T/mock/wifistub.cpp"
+SRC="$R/HttpStream.cpp $R/TcpStream.cpp $R/BufferPool.cpp"
+ALL="$SRC $R/RequestRouter.cpp $R/AdmissionController.cpp $R/IppStream.cpp $R/IppAttributeCache.cpp $R/Printer.cpp $R/PrintQueue.cpp $R/JobTable.cpp $R/Inflater.cpp $R/LoopProfiler.cpp $T/mock/fsmock.cpp"
+failed=0
+t() {
+  name=$1; shift
+  if ! g++ -std=gnu++11 -g -I"$T/mock" -I"$R" -include Arduino.h $MOCK "$T/$name.cpp" "$@" -o $name 2> $name.log; then
+    echo "$name: build failed, see build/$name.log"; failed=1
+  elif ! ./$name > $name.out 2>&1; then
+    echo "$name: FAILED"; tail -3 $name.out; failed=1
+  else
+    echo "$name: $(tail -1 $name.out)"
+  fi
+}
+t t_tcpstream $SRC
+t t_http $SRC
+t t_chunk $SRC
+t t_cache $ALL $T/mock/wifistub.cpp
+t t_alloc $ALL $T/mock/wifistub.cpp
+t t_jobs $ALL $T/mock/wifistub.cpp
+t t_inflate $R/Inflater.cpp
+t t_gzipjob $ALL $T/mock/wifistub.cpp
+t t_multidoc $ALL $T/mock/wifistub.cpp
+t t_router $R/RequestRouter.cpp $R/AdmissionController.cpp
+t t_wifiscan $R/WiFiManager.cpp
+t t_admit $ALL $NET $R/TcpPrintServer.cpp
+t t_metrics $ALL $NET $R/TcpPrintServer.cpp
+t t_appsocket $ALL $NET $R/TcpPrintServer.cpp
+t t_webform $ALL $NET $R/TcpPrintServer.cpp
+t t_keepalive $ALL $NET $R/TcpPrintServer.cpp
+t t_profiler $ALL $NET $R/TcpPrintServer.cpp
+t t_ramspool $ALL $NET $R/TcpPrintServer.cpp
+t t_priority $R/Printer.cpp $R/PrintQueue.cpp $R/JobTable.cpp $R/Inflater.cpp $T/mock/fsmock.cpp
+exit $failed
@@ -0,0 +1,76 @@
+// admission limits and slot reclamation, through TcpPrintServer
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+#include <map>
+extern size_t mockChunk;
+struct P: Printer { std::string out; bool ready = true; P(const char* n): Printer(n) {} bool canPrint() { return ready; } void printByte(byte b) { out += (char) b; } String getInfo() {return "";} };
+static void attr(std::string& b, byte tag, const std::string& name, const std::string& value) {
+  b += (char) tag; b += (char) (name.size() >> 8); b += (char) name.size(); b += name;
+  b += (char) (value.size() >> 8); b += (char) value.size(); b += value;
+}
+static std::string printJob(const char* printer, const std::string& data, bool expectContinue = false) {
+  std::string body = std::string("\x01\x01\x00\x02\x00\x00\x00\x07\x01", 9);
+  attr(body, 0x47, "attributes-charset", "utf-8");
+  attr(body, 0x48, "attributes-natural-language", "en-us");
+  body += "\x03" + data;
+  char head[128]; snprintf(head, sizeof head, "POST /%s HTTP/1.1\r\nContent-Length: %zu\r\n%s\r\n", printer, body.size(), expectContinue ? "Expect: 100-continue\r\n" : "");
+  return head + body;
+}
+static void run(TcpPrintServer& server, P& a, P& b, int passes) {
+  for (int i = 0; i < passes; i++) { server.process(); a.processQueue(); b.processQueue(); mockClockOffsetUs += SERVICE_INTERVAL_MS * 1000; }
+}
+static uint16_t ippStatus(int socket) {
+  const std::string& out = mockSockets[socket].output;
+  size_t body = out.find("\r\n\r\n"); assert(body != std::string::npos);
+  if (out.find("chunked") != std::string::npos) body = out.find("\r\n", body + 4) - 2; //skip the chunk size
+  return ((byte) out[body + 6] << 8) | (byte) out[body + 7];
+}
+int main() {
+  mockChunk = 1460;
+  P usb("usb"), serial("serial"); usb.init(); serial.init();
+  Printer* printers[] = {&usb, &serial};
+  TcpPrintServer server(printers, 2);
+  server.start();
+  // three socket jobs that keep their connection open: the most one printer gets
+  int sockets[4];
+  for (int i = 0; i < 4; i++) sockets[i] = mockConnect(SOCKET_SERVER_PORT, std::string(100, 'a' + i), true);
+  run(server, usb, serial, 10);
+  assert(mockSockets[sockets[2]].pos == 100 && mockSockets[sockets[3]].pos == 0); //the 4th waits in the backlog
+  // an IPP job for the same printer is refused right away, without reading its attributes
+  int refused = mockConnect(IPP_SERVER_PORT, printJob("usb", std::string(5000, 'x')), true);
+  run(server, usb, serial, 5);
+  assert(ippStatus(refused) == IPP_SERVER_ERROR_BUSY && mockSockets[refused].stopped);
+  assert(mockSockets[refused].output.find("printer-uri") == std::string::npos);
+  // one waiting for 100 Continue is turned away before it sends anything more
+  int early = mockConnect(IPP_SERVER_PORT, printJob("usb", std::string(5000, 'x'), true), true);
+  run(server, usb, serial, 5);
+  assert(mockSockets[early].output.compare(0, 12, "HTTP/1.1 503") == 0 && mockSockets[early].stopped);
+  assert(mockSockets[early].output.find("100 Continue") == std::string::npos);
+  // the other printer still gets the last slot
+  int admitted = mockConnect(IPP_SERVER_PORT, printJob("serial", "hello", true));
+  run(server, usb, serial, 5);
+  assert(mockSockets[admitted].output.compare(0, 25, "HTTP/1.1 100 Continue\r\n\r\n") == 0);
+  mockSockets[admitted].output.erase(0, 25);
+  assert(ippStatus(admitted) == IPP_SUCCESFUL_OK && serial.out == "hello");
+  // idle clients are reclaimed: their jobs end with what they sent, and the waiting one gets in
+  mockClockOffsetUs += (CLIENT_IDLE_TIMEOUT_MS + 1000) * 1000ULL;
+  run(server, usb, serial, 5);
+  for (int i = 0; i < 3; i++) assert(mockSockets[sockets[i]].stopped);
+  assert(mockSockets[sockets[3]].pos == 100 && !mockSockets[sockets[3]].stopped);
+  run(server, usb, serial, 20); //the spooled ones print once the direct job is done
+  assert(usb.getJobs().find(1)->state == JOB_COMPLETED);
+  for (uint32_t id = 2; id <= 3; id++) assert(usb.getJobs().find(id)->clientId == -1 && usb.getJobs().find(id)->state == JOB_PENDING);
+  // a job that can't move (the printer is stuck, the client keeps sending) is aborted
+  serial.ready = false;
+  int stuck = mockConnect(IPP_SERVER_PORT, printJob("serial", std::string(20000, 's')), true);
+  run(server, usb, serial, 5);
+  assert(ippStatus(stuck) == IPP_SUCCESFUL_OK);
+  for (int i = 0; i < 4; i++) { mockClockOffsetUs += (CLIENT_IDLE_TIMEOUT_MS / 2) * 1000ULL; run(server, usb, serial, 2); }
+  assert(!mockSockets[stuck].stopped); //not idle: its data is waiting for the printer
+  mockClockOffsetUs += JOB_TIMEOUT_MS * 1000ULL;
+  run(server, usb, serial, 2);
+  assert(mockSockets[stuck].stopped && serial.getJobs().find(2)->state == JOB_ABORTED);
+  puts("ok");
+}
@@ -0,0 +1,37 @@
+// raw jobs on per-printer ports, through TcpPrintServer
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+extern size_t mockChunk;
+struct P: Printer { std::string out; P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte b) { out += (char) b; } String getInfo() {return "";} };
+#define N (MAX_SOCKET_SERVERS + 1)
+static P* ps[N];
+static void run(TcpPrintServer& server, int passes) {
+  for (int i = 0; i < passes; i++) { server.process(); for (int j = 0; j < N; j++) ps[j]->processQueue(); mockClockOffsetUs += SERVICE_INTERVAL_MS * 1000; }
+}
+int main() {
+  mockChunk = 1460;
+  const char* names[] = {"p0", "p1", "p2", "p3", "p4", "p5", "p6", "p7"};
+  for (int i = 0; i < N; i++) { ps[i] = new P(names[i]); ps[i]->init(); }
+  TcpPrintServer server((Printer**) ps, N);
+  server.start();
+  // every listener gets its turn: a backlog on the first port doesn't hold up the others
+  for (int i = 0; i < 3; i++) mockConnect(SOCKET_SERVER_PORT, "zero");
+  for (int i = 1; i < MAX_SOCKET_SERVERS; i++) mockConnect(SOCKET_SERVER_PORT + i, std::string("job") + char('0' + i));
+  int unserved = mockConnect(SOCKET_SERVER_PORT + MAX_SOCKET_SERVERS, "nobody listens");
+  run(server, 40);
+  assert(ps[0]->out == "zerozerozero");
+  for (int i = 1; i < MAX_SOCKET_SERVERS; i++) assert(ps[i]->out == std::string("job") + char('0' + i));
+  assert(ps[N - 1]->out.empty() && mockSockets[unserved].pos == 0);
+  int web = mockConnect(HTTP_SERVER_PORT, "GET /printerInfo HTTP/1.1\r\n\r\n");
+  run(server, 5);
+  const std::string& page = mockSockets[web].output;
+  for (int i = 0; i < MAX_SOCKET_SERVERS; i++) assert(page.find("socket://10.0.0.2:" + std::to_string(SOCKET_SERVER_PORT + i)) != std::string::npos);
+  assert(page.find("socket://10.0.0.2:" + std::to_string(SOCKET_SERVER_PORT + MAX_SOCKET_SERVERS)) == std::string::npos);
+  // idle listeners cost next to nothing per pass
+  unsigned long start = micros(); int passes = 100000;
+  for (int i = 0; i < passes; i++) server.process();
+  printf("idle pass with %d listeners: %.0f ns\n", MAX_SOCKET_SERVERS, (micros() - start) * 1000.0 / passes);
+  puts("ok");
+}
@@ -0,0 +1,42 @@
+#include "IppAttributeCache.h"
+#include "WiFiManager.h"
+#include <cassert>
+#include <vector>
+struct P: Printer { P(): Printer("usb") {} bool canPrint() {return true;} void printByte(byte) {} String getInfo() {return "";} };
+extern std::string mockOutput;
+void dump(const std::string& ds) {
+  const uint8_t* d = (const uint8_t*) ds.data(); size_t i = 0;
+  while (i < ds.size()) {
+    byte tag = d[i]; int nl = d[i+1]<<8|d[i+2];
+    std::string name((const char*)&d[i+3], nl); i += 3+nl;
+    int vl = d[i]<<8|d[i+1]; i += 2;
+    printf("%02x %s len %d", tag, name.c_str(), vl);
+    if (vl==4) printf(" = %d", d[i]<<24|d[i+1]<<16|d[i+2]<<8|d[i+3]);
+    puts(""); i += vl;
+  }
+  assert(i == ds.size());
+}
+int main() {
+  P p; IppAttributeCache c; c.update(&p);
+  assert(IppAttributeCache::findAttributes("charset-configured") == 1);
+  assert(IppAttributeCache::findAttributes("uri-security-supported") == 1UL << 22);
+  assert(IppAttributeCache::findAttributes("nope") == 0);
+  assert(IppAttributeCache::findAttributes("all") == 0x7FFFFF);
+  assert(IppAttributeCache::findAttributes("printer-description") == 0x7FFFFF);
+  WiFiClient w; TcpStream s; s.begin(w);
+  c.writeAttributes(s, IppAttributeCache::findAttributes("all")); s.flushSendBuffer();
+  dump(mockOutput); mockOutput.clear();
+  c.writeAttributes(s, IppAttributeCache::findAttributes("printer-state") | IppAttributeCache::findAttributes("printer-name") | IppAttributeCache::findAttributes("charset-supported")); s.flushSendBuffer();
+  puts("--"); dump(mockOutput);
+  // an IP or compression change rewrites its attribute in place: the blob matches a fresh one
+  extern uint32_t mockIPAddress; extern uint16_t mockMaxFreeBlock;
+  auto all = [&](IppAttributeCache& cache) { cache.update(&p); mockOutput.clear(); cache.writeAttributes(s, IppAttributeCache::findAttributes("all")); s.flushSendBuffer(); return mockOutput; };
+  for (uint32_t ip : {0xFFFFFFFFu, 0u, 0x0100007Fu}) for (uint16_t block : {20000, 36000, 20000}) {
+    mockIPAddress = ip; mockMaxFreeBlock = block;
+    IppAttributeCache fresh;
+    std::string expected = all(fresh), patched = all(c);
+    assert(patched == expected && patched.find("ipp://" + std::string(WiFiManager::getIP().c_str()) + ":") != std::string::npos);
+    assert((patched.find("gzip") != std::string::npos) == (block == 36000) && patched.size() <= IPP_ATTRIBUTES_SIZE);
+  }
+  puts("ok");
+}
@@ -0,0 +1,21 @@
+#include "HttpStream.h"
+#include <assert.h>
+extern std::string mockInput, mockOutput; extern size_t mockPos;
+std::string dechunk(const std::string& o, std::string& head) {
+  size_t p = o.find("\r\n\r\n"); head = o.substr(0, p + 4); p += 4; std::string body;
+  while (true) { size_t e = o.find("\r\n", p); long n = strtol(o.substr(p, e - p).c_str(), 0, 16); p = e + 2; if (!n) { assert(o.substr(p) == "\r\n"); break; } body += o.substr(p, n); p += n; assert(o.substr(p, 2) == "\r\n"); p += 2; }
+  return body;
+}
+int main() {
+  for (int total : {0, 1, 100, 1440, 1445, 1460, 3000, 9000}) for (int piece : {1, 7, 200, 1500, 4000}) {
+    mockOutput.clear(); mockInput = ""; HttpStream h; h.begin(WiFiClient());
+    h.beginResponse(F("200 OK"), F("application/ipp"), true);
+    std::string expect; int w = 0;
+    while (w < total) { int n = std::min(piece, total - w); std::string s(n, 'a' + (w % 26)); h.write((const byte*) s.data(), n); expect += s; w += n; }
+    h.endResponse();
+    std::string head; std::string body = dechunk(mockOutput, head);
+    assert(body == expect); assert(head.find("Transfer-Encoding: chunked") != std::string::npos);
+    assert(BufferPool::usedBuffers() == 0);
+  }
+  printf("ok\n");
+}
@@ -0,0 +1,108 @@
+#include "IppStream.h"
+#include "WiFiManager.h"
+#include <cassert>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <chrono>
+static const RequestRouter& usbRoute() { static RequestRouter r; static bool b = r.add("POST", "usb", 0); (void) b; return r; }
+extern std::string mockInput, mockOutput; extern size_t mockPos, mockChunk;
+struct P: Printer { std::string out; int n = 0; P(): Printer("usb") {} bool canPrint() { return ++n % 5 != 0; } void printByte(byte b) { out += (char) b; } String getInfo() {return "";} };
+static std::string load(const std::string& path) { std::ifstream f(path, std::ios::binary); std::stringstream s; s << f.rdbuf(); return s.str(); }
+static void attr(std::string& b, byte tag, const std::string& name, const std::string& value) {
+  b += (char) tag; b += (char) (name.size() >> 8); b += (char) name.size(); b += name;
+  b += (char) (value.size() >> 8); b += (char) value.size(); b += value;
+}
+static std::string printJob(const char* compression, const std::string& data, const std::string& jobName = "", const std::string& jobUri = "") {
+  std::string body = std::string("\x01\x01\x00\x02\x00\x00\x00\x07\x01", 9);
+  attr(body, 0x47, "attributes-charset", "utf-8");
+  attr(body, 0x48, "attributes-natural-language", "en-us");
+  if (!jobUri.empty()) attr(body, 0x45, "job-uri", jobUri);
+  if (!jobName.empty()) { attr(body, 0x42, "job-name", jobName); attr(body, 0x42, "", "a second value"); }
+  if (compression) attr(body, 0x44, "compression", compression);
+  body += "\x03" + data;
+  char head[128]; snprintf(head, sizeof head, "POST /usb HTTP/1.1\r\nContent-Length: %zu\r\n\r\n", body.size());
+  return head + body;
+}
+// the server's handleClient() and the main loop, for one client
+static double run(P& p, const std::string& request, int slot, bool untilIdle) {
+  Printer* printers[] = {&p}; IppAttributeCache caches[1];
+  auto start = std::chrono::steady_clock::now();
+  mockInput = request; mockPos = 0; mockOutput.clear();
+  IppStream s; s.begin(WiFiClient());
+  while (s.parseRequestHeader() == HTTP_HEAD_INCOMPLETE);
+  assert(s.parseRequest(usbRoute(), printers, caches, AdmissionController()) == 0);
+  Printer* pr = &p;
+  s.sendJobResponse(pr->startJob(slot, s.getJobName(), s.getCompression()));
+  while (s.hasMoreData()) {
+    byte b; if (pr->canPrint(slot) && s.readBytes(&b, 1)) pr->write(slot, &b, 1);
+    pr->processQueue();
+  }
+  pr->endJob(slot, JOB_COMPLETED);
+  while (untilIdle && pr->getStatus() != IDLE) pr->processQueue();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+int main() {
+  mockChunk = 1460;
+  std::string raw = load("inf/raster.raw"), gz = load("inf/raster.gz"), def = load("inf/raster.6.deflate");
+  for (int round = 0; round < 2; round++) {
+    P plain; double tPlain = run(plain, printJob(NULL, raw), 0, true);
+    assert(plain.out == raw);
+    P p; double tGzip = run(p, printJob("gzip", gz), 0, true);
+    assert(p.out == raw);
+    if (round) printf("raster job %zu bytes: uncompressed %zu bytes on the wire, %.1f ms; gzip %zu bytes on the wire, %.1f ms\n", raw.size(), raw.size(), tPlain, gz.size(), tGzip);
+  }
+  // a long job-name is cut short, and doesn't crowd out the compression that follows it
+  for (size_t length : {110, 120, 200}) {
+    P p; run(p, printJob("gzip", gz, std::string(length, 'n')), 0, true);
+    assert(p.out == raw && p.getJobs().find(1)->name == std::string(JOB_NAME_LENGTH, 'n'));
+  }
+  // a kept value that doesn't fit fails the request instead of being dropped
+  mockInput = printJob("gzip", gz, std::string(120, 'n'), "ipp://10.0.0.2:631/usb/" + std::string(60, '1')); mockPos = 0; mockOutput.clear();
+  { IppStream s; s.begin(WiFiClient()); while (s.parseRequestHeader() == HTTP_HEAD_INCOMPLETE); P p; Printer* printers[] = {&p}; IppAttributeCache caches[1];
+    assert(s.parseRequest(usbRoute(), printers, caches, AdmissionController()) == -1); s.flushSendBuffer(); assert(mockOutput.find(std::string("\x04\x09", 2)) != std::string::npos); }
+  // a deflate job arriving while the printer is busy: spooled compressed, inflated from the queue
+  P p; Printer* pr = &p; p.init();
+  pr->startJob(1); //keeps the printer busy
+  run(p, printJob("deflate", def), 0, false);
+  extern std::map<std::string, std::string> mockFiles;
+  size_t spooled = 0; for (auto& f: mockFiles) if (f.first != "usb") spooled += f.second.size();
+  assert(spooled == def.size() + 3);
+  pr->endJob(1, JOB_COMPLETED);
+  for (int i = 0; i < 10000000 && !(pr->getStatus() == IDLE && i > 10); i++) pr->processQueue();
+  assert(p.out == raw);
+  assert(p.getJobs().find(2)->state == JOB_COMPLETED);
+  // an unsupported compression is refused
+  mockInput = printJob("compress", "xx"); mockPos = 0; mockOutput.clear();
+  { IppStream s; s.begin(WiFiClient()); while (s.parseRequestHeader() == HTTP_HEAD_INCOMPLETE); Printer* printers[] = {&p}; IppAttributeCache caches[1];
+    assert(s.parseRequest(usbRoute(), printers, caches, AdmissionController()) == -1); s.flushSendBuffer(); assert(mockOutput.find(std::string("\x04\x0F", 2)) != std::string::npos); }
+  // a spooled deflate job that can't have the window once it's its turn is aborted, not left waiting
+  extern uint16_t mockMaxFreeBlock;
+  pr->startJob(1);
+  run(p, printJob("deflate", def), 0, false);
+  const uint32_t starved = 4; //after the job keeping the printer busy
+  mockMaxFreeBlock = 20000;
+  pr->endJob(1, JOB_COMPLETED);
+  for (int i = 0; i < 1000 && !(pr->getStatus() == IDLE && i > 10); i++) pr->processQueue();
+  assert(pr->getStatus() == IDLE && p.getQueuedJobCount() == 0);
+  assert(p.getJobs().find(starved)->state == JOB_ABORTED);
+  // and while the heap is that short, compressed jobs are refused and not advertised
+  mockInput = printJob("gzip", gz); mockPos = 0; mockOutput.clear();
+  { IppStream s; s.begin(WiFiClient()); while (s.parseRequestHeader() == HTTP_HEAD_INCOMPLETE); Printer* printers[] = {&p}; IppAttributeCache caches[1];
+    assert(s.parseRequest(usbRoute(), printers, caches, AdmissionController()) == -1); s.flushSendBuffer(); assert(mockOutput.find(std::string("\x04\x0F", 2)) != std::string::npos); }
+  for (uint16_t block : {20000, 36000}) {
+    mockMaxFreeBlock = block;
+    std::string body = std::string("\x01\x01\x00\x0B\x00\x00\x00\x07\x01", 9);
+    attr(body, 0x47, "attributes-charset", "utf-8");
+    attr(body, 0x48, "attributes-natural-language", "en-us");
+    attr(body, 0x44, "requested-attributes", "compression-supported");
+    body += "\x03";
+    char head[128]; snprintf(head, sizeof head, "POST /usb HTTP/1.1\r\nContent-Length: %zu\r\n\r\n", body.size());
+    mockInput = head + body; mockPos = 0; mockOutput.clear();
+    static IppAttributeCache caches[1]; //kept: the blob follows the heap
+    IppStream s; s.begin(WiFiClient()); while (s.parseRequestHeader() == HTTP_HEAD_INCOMPLETE); Printer* printers[] = {&p};
+    assert(s.parseRequest(usbRoute(), printers, caches, AdmissionController()) == -1); s.flushSendBuffer();
+    assert(mockOutput.find("none") != std::string::npos && (mockOutput.find("gzip") != std::string::npos) == (block == 36000));
+  }
+  puts("ok");
+}
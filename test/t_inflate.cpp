@@ -0,0 +1,47 @@
+#include "Inflater.h"
+#include <cassert>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <dirent.h>
+static std::string load(const std::string& path) { std::ifstream f(path, std::ios::binary); std::stringstream s; s << f.rdbuf(); return s.str(); }
+static bool run(const std::string& in, compression_type type, std::string& out, bool stall) {
+  Inflater inflater; assert(inflater.begin(type) == INFLATE_STARTED);
+  Inflater other; assert(!other.begin(type)); //one window at a time
+  size_t pos = 0; int r;
+  while (true) {
+    if (pos < in.size()) {
+      size_t n = std::min((size_t) (1 + rand() % 700), in.size() - pos);
+      if (n > inflater.inputRoom()) n = inflater.inputRoom();
+      pos += inflater.write((const byte*) in.data() + pos, n);
+    }
+    int budget = stall ? rand() % 300 : 1 << 30;
+    while (budget-- > 0 && (r = inflater.read()) >= 0) out += (char) r;
+    if (budget >= 0 && r == INFLATE_NEED_INPUT && pos == in.size()) break;
+    if (budget >= 0 && r < INFLATE_NEED_INPUT) break;
+  }
+  bool ok = r == INFLATE_END;
+  inflater.end();
+  return ok;
+}
+int main() {
+  DIR* d = opendir("inf"); struct dirent* e; int n = 0;
+  while ((e = readdir(d))) {
+    std::string name = e->d_name; if (name[0] == '.' || name.find(".raw") != std::string::npos) continue;
+    std::string base = name.substr(0, name.find('.'));
+    std::string expected = load("inf/" + base + ".raw");
+    compression_type type = name.find(".gz") != std::string::npos ? COMPRESSION_GZIP : COMPRESSION_DEFLATE;
+    for (int stall = 0; stall < 2; stall++) {
+      std::string out;
+      bool ok = run(load("inf/" + name), type, out, stall);
+      if (!ok || out != expected) { printf("FAIL %s stall=%d ok=%d got %zu want %zu\n", name.c_str(), stall, ok, out.size(), expected.size()); return 1; }
+      n++;
+    }
+  }
+  // corrupt input must fail, not hang or crash
+  std::string bad = load("inf/text.6.deflate"); for (size_t i = 10; i < bad.size(); i += 97) bad[i] ^= 0x5A;
+  std::string out; assert(!run(bad, COMPRESSION_DEFLATE, out, false));
+  std::string notgzip = load("inf/text.6.zlib"); out.clear(); assert(!run(notgzip, COMPRESSION_GZIP, out, false));
+  printf("ok %d\n", n);
+}
@@ -0,0 +1,81 @@
+#include "IppStream.h"
+#include "WiFiManager.h"
+#include <cassert>
+static const RequestRouter& usbRoute() { static RequestRouter r; static bool b = r.add("POST", "usb", 0); (void) b; return r; }
+extern std::string mockInput, mockOutput; extern size_t mockPos, mockChunk;
+struct P: Printer { std::string out; P(): Printer("usb") {} bool canPrint() {return true;} void printByte(byte b) { out += (char) b; } String getInfo() {return "";} };
+static void attr(std::string& b, byte tag, const std::string& name, const std::string& value) {
+  b += (char) tag; b += (char) (name.size() >> 8); b += (char) name.size(); b += name;
+  b += (char) (value.size() >> 8); b += (char) value.size(); b += value;
+}
+static std::string be4(uint32_t v) { std::string s; s += (char)(v >> 24); s += (char)(v >> 16); s += (char)(v >> 8); s += (char) v; return s; }
+static int request(IppStream& s, Printer** printers, IppAttributeCache* caches, uint16_t op, const std::string& extra, const std::string& data = "") {
+  std::string body = std::string("\x01\x01", 2) + (char)(op >> 8) + (char) op + be4(7) + "\x01";
+  attr(body, 0x47, "attributes-charset", "utf-8");
+  attr(body, 0x48, "attributes-natural-language", "en-us");
+  body += extra + "\x03" + data;
+  char head[128]; snprintf(head, sizeof head, "POST /usb HTTP/1.1\r\nContent-Length: %zu\r\n\r\n", body.size());
+  mockInput = head + body; mockPos = 0; mockOutput.clear();
+  s.begin(WiFiClient());
+  while (s.parseRequestHeader() == HTTP_HEAD_INCOMPLETE);
+  return s.parseRequest(usbRoute(), printers, caches, AdmissionController());
+}
+static uint16_t status() { size_t p = mockOutput.find("\r\n\r\n") + 4; p = mockOutput.find("\r\n", p) + 2; return (byte) mockOutput[p + 2] << 8 | (byte) mockOutput[p + 3]; }
+int main() {
+  mockChunk = 4096;
+  P p; p.init(); Printer* pr = &p; Printer* printers[] = {&p}; IppAttributeCache caches[1];
+  IppStream s;
+  std::string name; attr(name, 0x42, "job-name", "first");
+  assert(request(s, printers, caches, IPP_PRINT_JOB, name, "AAA") == 0);
+  uint32_t direct = p.startJob(0, s.getJobName());
+  s.sendJobResponse(direct); s.flushSendBuffer();
+  assert(direct == 1 && mockOutput.find("job-uri") != std::string::npos && mockOutput.find("ipp://10.0.0.2:631/usb/1") != std::string::npos);
+  byte b; while (s.hasMoreData()) if (s.readBytes(&b, 1)) pr->write(0, &b, 1);
+  // two spooled jobs while the first one is still printing
+  uint32_t spooled1 = p.startJob(1); pr->write(1, (const byte*) "B", 1); p.endJob(1, JOB_COMPLETED);
+  uint32_t spooled2 = p.startJob(2); pr->write(2, (const byte*) "C", 1); p.endJob(2, JOB_COMPLETED);
+  uint32_t receiving = p.startJob(3); pr->write(3, (const byte*) "D", 1);
+  assert(p.getJobs().find(spooled1)->state == JOB_PENDING);
+  // cancel a spooled job and one still being received
+  assert(request(s, printers, caches, IPP_CANCEL_JOB, [&]{ std::string e; attr(e, 0x21, "job-id", be4(spooled1)); return e; }()) == -1);
+  s.flushSendBuffer(); assert(status() == IPP_SUCCESFUL_OK);
+  assert(p.getJobs().find(spooled1)->state == JOB_CANCELED);
+  assert(request(s, printers, caches, IPP_CANCEL_JOB, [&]{ std::string e; attr(e, 0x45, "job-uri", "ipp://10.0.0.2:631/usb/" + std::to_string(receiving)); return e; }()) == -1);
+  s.flushSendBuffer(); assert(status() == IPP_SUCCESFUL_OK);
+  assert(p.isCancelRequested(3)); p.endJob(3, JOB_CANCELED);
+  assert(p.getJobs().find(receiving)->state == JOB_CANCELED);
+  p.endJob(0, JOB_COMPLETED);
+  assert(p.getJobs().find(direct)->state == JOB_COMPLETED && p.getJobs().find(direct)->bytes == 3);
+  assert(request(s, printers, caches, IPP_CANCEL_JOB, [&]{ std::string e; attr(e, 0x21, "job-id", be4(direct)); return e; }()) == -1);
+  s.flushSendBuffer(); assert(status() == IPP_CLIENT_ERROR_NOT_POSSIBLE);
+  assert(request(s, printers, caches, IPP_GET_JOB_ATTRIBUTES, [&]{ std::string e; attr(e, 0x21, "job-id", be4(99)); return e; }()) == -1);
+  s.flushSendBuffer(); assert(status() == IPP_CLIENT_ERROR_NOT_FOUND);
+  for (int i = 0; i < 20; i++) p.processQueue();
+  assert(p.out == "AAAC");
+  assert(p.getJobs().find(spooled2)->state == JOB_COMPLETED);
+  assert(request(s, printers, caches, IPP_GET_JOBS, [&]{ std::string e; attr(e, 0x44, "which-jobs", "completed"); attr(e, 0x44, "requested-attributes", "job-state"); return e; }()) == -1);
+  s.flushSendBuffer(); assert(status() == IPP_SUCCESFUL_OK);
+  int groups = 0; for (size_t i = mockOutput.find("job-id"); i != std::string::npos; i = mockOutput.find("job-id", i + 1)) groups++;
+  assert(groups == 4);
+  assert(request(s, printers, caches, IPP_GET_JOBS, "") == -1);
+  s.flushSendBuffer(); assert(mockOutput.find("job-id") == std::string::npos);
+  // a job that's no longer in the table is answered with not-found, not dereferenced
+  assert(request(s, printers, caches, IPP_PRINT_JOB, "") == 0);
+  mockOutput.clear(); s.sendJobResponse(12345); s.flushSendBuffer();
+  assert(status() == IPP_CLIENT_ERROR_NOT_FOUND && mockOutput.find("job-id") == std::string::npos);
+  // jobs waiting in the spool are never evicted: once the table holds nothing else, new jobs are refused
+  p.out.clear();
+  uint32_t printing = p.startJob(0);
+  uint32_t first = p.startJob(1); pr->write(1, (const byte*) "E", 1); p.endJob(1, JOB_COMPLETED);
+  int spooled = 1;
+  while (p.canAcceptJob()) { p.startJob(1); pr->write(1, (const byte*) "F", 1); p.endJob(1, JOB_COMPLETED); spooled++; }
+  assert(spooled == JOB_TABLE_SIZE - 1 && p.getJobs().find(first)->state == JOB_PENDING);
+  assert(request(s, printers, caches, IPP_PRINT_JOB, "") == -1);
+  s.flushSendBuffer(); assert(status() == IPP_SERVER_ERROR_BUSY);
+  p.endJob(0, JOB_COMPLETED);
+  assert(p.canAcceptJob());
+  for (int i = 0; i < 200; i++) p.processQueue();
+  assert(p.out == "E" + std::string(spooled - 1, 'F'));
+  for (Job* job = p.getJobs().next(printing - 1); job != NULL; job = p.getJobs().next(job->id)) assert(job->state == JOB_COMPLETED);
+  puts("ok");
+}
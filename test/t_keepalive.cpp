@@ -0,0 +1,60 @@
+// persistent IPP connections wait for their next request apart from the clients being served
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+extern size_t mockChunk;
+struct P: Printer { P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte) {} String getInfo() {return "";} };
+static void attr(std::string& b, byte tag, const std::string& name, const std::string& value) {
+  b += (char) tag; b += (char) (name.size() >> 8); b += (char) name.size(); b += name;
+  b += (char) (value.size() >> 8); b += (char) value.size(); b += value;
+}
+// a Get-Printer-Attributes request on a connection that stays open after the response
+static std::string getAttributes() {
+  std::string body = std::string("\x01\x01\x00\x0B\x00\x00\x00\x07\x01", 9);
+  attr(body, 0x47, "attributes-charset", "utf-8");
+  attr(body, 0x48, "attributes-natural-language", "en-us");
+  attr(body, 0x44, "requested-attributes", "printer-state");
+  body += "\x03";
+  return "POST /usb HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+static size_t responses(int socket) {
+  size_t count = 0;
+  for (size_t p = mockSockets[socket].output.find("HTTP/1.1 200"); p != std::string::npos; p = mockSockets[socket].output.find("HTTP/1.1 200", p + 1)) count++;
+  return count;
+}
+static void run(TcpPrintServer& server, int passes) {
+  for (int i = 0; i < passes; i++) { server.process(); mockClockOffsetUs += SERVICE_INTERVAL_MS * 1000; }
+}
+static std::string metrics(TcpPrintServer& server) {
+  int web = mockConnect(HTTP_SERVER_PORT, "GET /metrics HTTP/1.1\r\n\r\n");
+  run(server, 5);
+  return mockSockets[web].output;
+}
+int main() {
+  mockChunk = 1460;
+  P usb("usb"); usb.init();
+  Printer* printers[] = {&usb};
+  TcpPrintServer server(printers, 1);
+  server.start();
+  // as many idle persistent connections as there are pending slots don't keep a new client out
+  int idle[MAX_PENDING_CLIENTS];
+  for (int i = 0; i < MAX_PENDING_CLIENTS; i++) idle[i] = mockConnect(IPP_SERVER_PORT, getAttributes(), true);
+  run(server, 10);
+  for (int i = 0; i < MAX_PENDING_CLIENTS; i++) assert(responses(idle[i]) == 1 && !mockSockets[idle[i]].stopped);
+  int fresh = mockConnect(IPP_SERVER_PORT, getAttributes(), true);
+  run(server, 10);
+  assert(responses(fresh) == 1);
+  // an idle connection's next request is served on the same connection
+  mockSockets[idle[0]].input += getAttributes();
+  run(server, 10);
+  assert(responses(idle[0]) == 2 && !mockSockets[idle[0]].stopped);
+  // one that stays idle is closed after KEEP_ALIVE_TIMEOUT_MS, which isn't a request timeout
+  mockClockOffsetUs += KEEP_ALIVE_TIMEOUT_MS * 1000ULL;
+  run(server, 2);
+  assert(mockSockets[idle[1]].stopped && mockSockets[fresh].stopped);
+  std::string page = metrics(server);
+  assert(page.find("printserver_timeouts_total{kind=\"request\"} 0") != std::string::npos);
+  assert(page.find("printserver_timeouts_total{kind=\"keep_alive\"} 2") != std::string::npos);
+  puts("ok");
+}
@@ -0,0 +1,89 @@
+// /metrics counters, through TcpPrintServer
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+#include <new>
+#include <set>
+static int allocations = 0; static bool counting = false;
+void* operator new(size_t n) { if (counting) allocations++; return malloc(n); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+extern size_t mockChunk;
+// perPass: how many bytes the printer takes before run() comes round again (-1: no limit)
+struct P: Printer { std::string out; bool ready = true; int perPass = -1; P(const char* n): Printer(n) {} bool canPrint() { return ready && perPass != 0; } void printByte(byte b) { out += (char) b; if (perPass > 0) perPass--; } String getInfo() {return "";} };
+static P usb("usb"), serial("serial");
+static void run(TcpPrintServer& server, int passes) {
+  for (int i = 0; i < passes; i++) { server.process(); usb.processQueue(); serial.processQueue(); mockClockOffsetUs += SERVICE_INTERVAL_MS * 1000; }
+}
+static std::string scrape(TcpPrintServer& server) {
+  int web = mockConnect(HTTP_SERVER_PORT, "GET /metrics HTTP/1.1\r\n\r\n");
+  run(server, 3);
+  return mockSockets[web].output;
+}
+static bool has(const std::string& page, const std::string& line) { return page.find(line + "\r\n") != std::string::npos || page.find(line + "\n") != std::string::npos; }
+int main() {
+  mockChunk = 1460;
+  usb.init(); serial.init();
+  Printer* printers[] = {&usb, &serial};
+  TcpPrintServer server(printers, 2);
+  server.start();
+  usb.out.reserve(1 << 20);
+  // the first job is printed directly, the second one spooled behind it
+  int direct = mockConnect(SOCKET_SERVER_PORT, std::string(300000, 'd'), true);
+  run(server, 3);
+  counting = true;
+  run(server, 20); //data moving: no allocations
+  counting = false;
+  assert(allocations == 0 && mockSockets[direct].pos > 0 && mockSockets[direct].pos < 300000);
+  std::string page = scrape(server);
+  assert(page.find("Content-Type: text/plain; version=0.0.4") != std::string::npos);
+  assert(has(page, "# TYPE printserver_received_bytes_total counter"));
+  assert(page.find("printserver_connection_received_bytes{slot=\"0\",printer=\"usb\"} ") != std::string::npos);
+  assert(has(page, "printserver_active_slots 1") && has(page, "printserver_slots " + std::to_string(MAXCLIENTS)));
+  mockConnect(SOCKET_SERVER_PORT, "spooled", false);
+  mockSockets[direct].connected = false;
+  run(server, 400);
+  assert(usb.out.size() == 300007);
+  page = scrape(server);
+  assert(has(page, "printserver_received_bytes_total{printer=\"usb\"} 300007"));
+  assert(has(page, "printserver_printed_bytes_total{printer=\"usb\"} 300007"));
+  assert(has(page, "printserver_spooled_bytes_total{printer=\"usb\"} 7"));
+  assert(has(page, "printserver_jobs_started_total{printer=\"usb\"} 2"));
+  assert(has(page, "printserver_jobs_completed_total{printer=\"usb\"} 2"));
+  assert(has(page, "printserver_jobs_started_total{printer=\"serial\"} 0"));
+  assert(has(page, "printserver_queued_jobs{printer=\"usb\"} 0"));
+  assert(has(page, "printserver_active_slots 0"));
+  assert(has(page, "printserver_free_heap_bytes 40000") && has(page, "printserver_largest_free_block_bytes 36000"));
+  // a client that goes quiet is counted when its slot is reclaimed
+  mockConnect(SOCKET_SERVER_PORT + 1, "x", true);
+  run(server, 3);
+  mockClockOffsetUs += (CLIENT_IDLE_TIMEOUT_MS + 1000) * 1000ULL;
+  run(server, 3);
+  page = scrape(server);
+  assert(has(page, "printserver_timeouts_total{kind=\"idle_client\"} 1"));
+  assert(has(page, "printserver_jobs_completed_total{printer=\"serial\"} 1"));
+  // a slow printer's direct job is read from its socket in large blocks, not a little every pass
+  int slow = mockConnect(SOCKET_SERVER_PORT, std::string(5000, 's'), true);
+  std::set<size_t> readPositions;
+  for (int i = 0; i < 30; i++) { usb.perPass = 100; run(server, 1); readPositions.insert(mockSockets[slow].pos); }
+  usb.perPass = -1;
+  assert(mockSockets[slow].pos >= 3000 && readPositions.size() <= 6);
+  // the printer is blocked while it holds data up, and starved while it waits for the client's
+  unsigned long blocked = usb.getBlockedMillis(), starved = usb.getStarvedMillis();
+  usb.ready = false;
+  run(server, 20);
+  assert(usb.getBlockedMillis() - blocked >= 19 * SERVICE_INTERVAL_MS && usb.getStarvedMillis() == starved);
+  usb.ready = true;
+  run(server, 5);
+  assert(mockSockets[slow].pos == 5000);
+  blocked = usb.getBlockedMillis();
+  run(server, 20);
+  assert(usb.getStarvedMillis() - starved >= 19 * SERVICE_INTERVAL_MS && usb.getBlockedMillis() == blocked);
+  mockSockets[slow].connected = false;
+  run(server, 3);
+  page = scrape(server);
+  assert(has(page, "printserver_blocked_milliseconds_total{printer=\"usb\"} " + std::to_string(usb.getBlockedMillis())));
+  assert(has(page, "printserver_starved_milliseconds_total{printer=\"usb\"} " + std::to_string(usb.getStarvedMillis())));
+  puts("ok");
+}
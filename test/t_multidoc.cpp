@@ -0,0 +1,96 @@
+#include "IppStream.h"
+#include "WiFiManager.h"
+#include <cassert>
+#include <fstream>
+#include <sstream>
+#include <map>
+static const RequestRouter& usbRoute() { static RequestRouter r; static bool b = r.add("POST", "usb", 0); (void) b; return r; }
+extern std::string mockInput, mockOutput; extern size_t mockPos, mockChunk;
+struct P: Printer { std::string out; int n = 0; P(): Printer("usb") {} bool canPrint() { return ++n % 5 != 0; } void printByte(byte b) { out += (char) b; } String getInfo() {return "";} };
+static std::string load(const std::string& path) { std::ifstream f(path, std::ios::binary); std::stringstream s; s << f.rdbuf(); return s.str(); }
+static void attr(std::string& b, byte tag, const std::string& name, const std::string& value) {
+  b += (char) tag; b += (char) (name.size() >> 8); b += (char) name.size(); b += name;
+  b += (char) (value.size() >> 8); b += (char) value.size(); b += value;
+}
+static std::string request(uint16_t op, uint32_t jobId, int last, const char* compression, const std::string& data, bool expectContinue = false) {
+  std::string body = std::string("\x01\x01\x00", 3) + (char) op + std::string("\x00\x00\x00\x07\x01", 5);
+  attr(body, 0x47, "attributes-charset", "utf-8");
+  attr(body, 0x48, "attributes-natural-language", "en-us");
+  if (jobId) attr(body, 0x21, "job-id", std::string({(char) 0, (char) 0, (char) (jobId >> 8), (char) jobId}));
+  if (last >= 0) attr(body, 0x22, "last-document", std::string(1, (char) last));
+  if (compression) attr(body, 0x44, "compression", compression);
+  body += "\x03" + data;
+  char head[128]; snprintf(head, sizeof head, "POST /usb HTTP/1.1\r\nContent-Length: %zu\r\n%s\r\n", body.size(), expectContinue ? "Expect: 100-continue\r\n" : "");
+  return head + body;
+}
+// parses the request and returns the parseRequest() result, leaving the stream at the document
+static int parse(IppStream& s, P& p, const std::string& req, const AdmissionController& admission = AdmissionController()) {
+  Printer* printers[] = {&p}; IppAttributeCache caches[1];
+  mockInput = req; mockPos = 0; mockOutput.clear();
+  s.begin(WiFiClient());
+  while (s.parseRequestHeader() == HTTP_HEAD_INCOMPLETE);
+  return s.parseRequest(usbRoute(), printers, caches, admission);
+}
+static void feed(IppStream& s, Printer* pr, int slot) {
+  while (s.hasMoreData()) {
+    byte b; if (pr->canPrint(slot) && s.readBytes(&b, 1)) pr->write(slot, &b, 1);
+    pr->processQueue();
+  }
+}
+static void multidoc(const char* compression, const std::string& a, const std::string& b, const std::string& expected, bool spooled) {
+  extern std::map<std::string, std::string> mockFiles; mockFiles.clear();
+  P p; Printer* pr = &p; p.init();
+  if (spooled) pr->startJob(1); //keeps the printer busy
+  IppStream s;
+  assert(parse(s, p, request(IPP_CREATE_JOB, 0, -1, NULL, "")) == 0);
+  uint32_t id = pr->createJob(0, s.getJobName());
+  s.sendJobResponse(id); s.flushSendBuffer(); assert(s.isKeepAlive() || true);
+  assert(p.getJobs().find(id)->state == JOB_PENDING);
+  assert(parse(s, p, request(IPP_SEND_DOCUMENT, id, 0, compression, a)) == 0);
+  assert(s.getJobId() == id && !s.isLastDocument());
+  assert(pr->startDocument(0, s.getCompression()));
+  feed(s, pr, 0);
+  assert(parse(s, p, request(IPP_SEND_DOCUMENT, id, 1, compression, b)) == 0);
+  assert(s.isLastDocument());
+  assert(!pr->startDocument(0, compression ? COMPRESSION_NONE : COMPRESSION_GZIP)); //has to match the first document
+  assert(pr->startDocument(0, s.getCompression()));
+  feed(s, pr, 0);
+  pr->endJob(0, JOB_COMPLETED);
+  if (spooled) pr->endJob(1, JOB_COMPLETED);
+  for (int i = 0; i < 10000000 && !(pr->getStatus() == IDLE && i > 10); i++) pr->processQueue();
+  assert(p.out == expected);
+  assert(p.getJobs().find(id)->state == JOB_COMPLETED);
+  // the job has all its documents: no more are taken
+  assert(parse(s, p, request(IPP_SEND_DOCUMENT, id, 1, NULL, "")) == -1);
+  s.flushSendBuffer(); assert(mockOutput.find(std::string("\x04\x0C", 2)) != std::string::npos);
+}
+int main() {
+  mockChunk = 1460;
+  std::string text = load("inf/text.raw"), raster = load("inf/raster.raw");
+  for (int spooled = 0; spooled < 2; spooled++) {
+    multidoc(NULL, text, raster, text + raster, spooled);
+    multidoc("gzip", load("inf/text.gz"), load("inf/raster.fancy.gz"), text + raster, spooled);
+    multidoc("deflate", load("inf/text.6.deflate"), load("inf/raster.1.zlib"), text + raster, spooled);
+  }
+  // gzip padding after the last member is ignored
+  multidoc("gzip", load("inf/text.gz"), load("inf/raster.gz") + std::string(16, '\0'), text + raster, false);
+  // unknown job
+  P p; IppStream s;
+  assert(parse(s, p, request(IPP_SEND_DOCUMENT, 42, 1, NULL, "")) == -1);
+  s.flushSendBuffer(); assert(mockOutput.find(std::string("\x04\x06", 2)) != std::string::npos);
+  // a created job canceled before any document
+  Printer* pr = &p; uint32_t id = pr->createJob(2, NULL);
+  assert(pr->cancelJob(id) && pr->isCancelRequested(2));
+  pr->endJob(2, JOB_CANCELED);
+  assert(p.getJobs().find(id)->state == JOB_CANCELED && pr->getStatus() == IDLE);
+  // with no slot left, a client waiting for 100 Continue is only told to go on if one of the
+  // printer's slots is held for a job's next document
+  AdmissionController full;
+  for (int i = 0; i < MAX_CLIENTS_PER_PRINTER; i++) full.acquire(0);
+  assert(parse(s, p, request(IPP_PRINT_JOB, 0, -1, NULL, "x", true), full) == -1);
+  s.flushSendBuffer(); assert(mockOutput.compare(0, 12, "HTTP/1.1 503") == 0);
+  id = pr->createJob(1, NULL); full.setHeld(1, true);
+  assert(parse(s, p, request(IPP_SEND_DOCUMENT, id, 1, NULL, "x", true), full) == 0);
+  assert(mockOutput.compare(0, 21, "HTTP/1.1 100 Continue") == 0);
+  puts("ok");
+}
@@ -0,0 +1,80 @@
+// the spooled jobs are printed by priority, then smallest first, with aging; and the index is
+// rebuilt from the flash
+#include "Printer.h"
+#include <cassert>
+#include <map>
+extern std::map<std::string, std::string> mockFiles;
+extern unsigned long long mockClockOffsetUs;
+struct P: Printer { std::string out; bool ready = true; P(const char* n): Printer(n) {} bool canPrint() { return ready; } void printByte(byte b) { out += (char) b; } String getInfo() {return "";} };
+static void drain(P& p) { for (int i = 0; i < 2000; i++) p.processQueue(); }
+static void spool(P& p, int slot, const std::string& data, byte priority) {
+  p.startJob(slot, NULL, COMPRESSION_NONE, priority);
+  for (size_t done = 0; done < data.size(); ) {
+    size_t count = p.write(slot, (const byte*) data.data() + done, data.size() - done);
+    assert(count > 0);
+    done += count;
+  }
+  p.endJob(slot, JOB_COMPLETED);
+}
+int main() {
+  P usb("usb");
+  usb.init();
+  // behind a direct job: a big one (spilling from the RAM spool), a small one, an urgent one
+  usb.ready = false;
+  usb.startJob(0);
+  std::string big(9000, 'a'), small(100, 'b'), urgent(200, 'c'), low(50, 'l');
+  spool(usb, 1, big, 50);
+  spool(usb, 2, small, 50);
+  spool(usb, 3, urgent, 90);
+  assert(usb.getQueuedJobCount() == 4);
+  usb.endJob(0, JOB_COMPLETED);
+  usb.ready = true;
+  drain(usb);
+  assert(usb.out == urgent + small + big);
+  for (uint32_t id = 1; id <= 4; id++) assert(usb.getJobs().find(id)->state == JOB_COMPLETED);
+  assert(usb.getJobs().find(4)->priority == 90 && usb.getQueuedJobCount() == 0);
+  // a low priority job that has waited long enough goes before a newer, higher one
+  usb.out.clear(); usb.ready = false;
+  usb.startJob(0);
+  spool(usb, 1, low, 1);
+  mockClockOffsetUs += 50ULL * (JOB_AGING_MS) * 1000;
+  spool(usb, 2, small, 50);
+  spool(usb, 3, urgent, 60);
+  usb.endJob(0, JOB_COMPLETED);
+  usb.ready = true;
+  drain(usb);
+  assert(usb.out == urgent + low + small);
+  // canceling a waiting job takes it out of the index
+  usb.out.clear(); usb.ready = false;
+  usb.startJob(0);
+  spool(usb, 1, small, 50);
+  spool(usb, 2, urgent, 50);
+  assert(usb.cancelJob(10));
+  usb.endJob(0, JOB_COMPLETED);
+  usb.ready = true;
+  drain(usb);
+  assert(usb.out == urgent && usb.getJobs().find(10)->state == JOB_CANCELED && usb.getQueuedJobCount() == 0);
+  // after a restart: the complete spool files are found, with their priority; the incomplete one
+  // and another printer's are left alone
+  mockFiles["lp3OK"] = std::string("\xA3\0\x14", 3) + "third";
+  mockFiles["lp7OK"] = std::string("\xA3\0\x50", 3) + "seventh";
+  mockFiles["lp12OK"] = std::string("\xA3\0\x50", 3) + "twelfth";
+  mockFiles["lp9"] = std::string("\xA3\0\x50", 3) + "partial";
+  mockFiles["lp2x3OK"] = std::string("\xA3\0\x50", 3) + "other";
+  // older firmware's files, without the format byte: dropped rather than misread
+  mockFiles["lp5OK"] = std::string("\0\x50", 2) + "two-byte header";
+  mockFiles["lp6OK"] = std::string("\0", 1) + "one-byte header";
+  P lp("lp");
+  lp.init();
+  assert(lp.getQueuedJobCount() == 3);
+  // and listed in the job table, waiting
+  int listed = 0;
+  for (Job* job = lp.getJobs().next(0); job != NULL; job = lp.getJobs().next(job->id), listed++) assert(job->state == JOB_PENDING && job->clientId == -1 && job->bytes >= 5);
+  assert(listed == 3 && lp.getJobs().findSpooled(7)->bytes == 7);
+  drain(lp);
+  assert(lp.out == "seventh" "twelfth" "third");
+  for (Job* job = lp.getJobs().next(0); job != NULL; job = lp.getJobs().next(job->id)) assert(job->state == JOB_COMPLETED);
+  assert(!mockFiles.count("lp3OK") && !mockFiles.count("lp7OK") && mockFiles.count("lp9") && mockFiles.count("lp2x3OK"));
+  assert(!mockFiles.count("lp5OK") && !mockFiles.count("lp6OK"));
+  puts("ok");
+}
@@ -0,0 +1,39 @@
+// loop phase histograms, through TcpPrintServer
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+#include <chrono>
+extern size_t mockChunk;
+struct P: Printer { P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte) {} String getInfo() {return "";} };
+int main() {
+  mockChunk = 1460;
+  P usb("usb"); usb.init();
+  Printer* printers[] = {&usb};
+  TcpPrintServer server(printers, 1);
+  server.start();
+  LoopProfiler::calibrate();
+  mockConnect(SOCKET_SERVER_PORT, std::string(200000, 'x'));
+  for (int i = 0; i < 2000; i++) {
+    uint32_t loopStart = LoopProfiler::start();
+    server.process();
+    uint32_t queueStart = LoopProfiler::start();
+    usb.processQueue();
+    LoopProfiler::end(PHASE_QUEUE, queueStart);
+    LoopProfiler::end(PHASE_LOOP, loopStart);
+  }
+  int web = mockConnect(HTTP_SERVER_PORT, "GET /profile HTTP/1.1\r\n\r\n");
+  for (int i = 0; i < 5; i++) { mockClockOffsetUs += SERVICE_INTERVAL_MS * 1000; server.process(); }
+  const std::string& page = mockSockets[web].output;
+  fputs(page.substr(page.find("\r\n\r\n") + 4).c_str(), stdout);
+  assert(page.find("\nloop                     2000 ") != std::string::npos);
+  assert(page.find("\nclients                  200") != std::string::npos); //and the ones serving the page
+  assert(page.find("profiler overhead: ") != std::string::npos);
+  // what a measured phase costs on the host
+  const int rounds = 10000000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) LoopProfiler::end(PHASE_DEBUG, LoopProfiler::start());
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+  printf("start()+end(): %.1f ns per measured phase, %.1f ns per loop pass (%d phases)\n", ns, ns * (PHASE_COUNT - 1), PHASE_COUNT - 1);
+  puts("ok");
+}
@@ -0,0 +1,68 @@
+// the RAM spool in front of the flash, through TcpPrintServer
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+#include <vector>
+#include <map>
+extern size_t mockChunk;
+struct MockFlashWrite { std::string path; size_t offset, length; };
+extern std::vector<MockFlashWrite> mockFlashWrites;
+extern std::map<std::string, std::string> mockFiles;
+struct P: Printer { std::string out; bool ready = true; P(const char* n): Printer(n) {} bool canPrint() { return ready; } void printByte(byte b) { out += (char) b; } String getInfo() {return "";} };
+static P usb("usb");
+static void run(TcpPrintServer& server, int passes) {
+  for (int i = 0; i < passes; i++) { server.process(); usb.processQueue(); mockClockOffsetUs += SERVICE_INTERVAL_MS * 1000; }
+}
+static size_t writesTo(const char* path) { size_t n = 0; for (auto& w : mockFlashWrites) if (w.path == path) n++; return n; }
+int main() {
+  mockChunk = 1460;
+  usb.init();
+  Printer* printers[] = {&usb};
+  TcpPrintServer server(printers, 1);
+  server.start();
+  // a receipt arriving while another job prints directly: it's spooled in RAM, its client is done
+  // right away, and it never touches the flash
+  usb.ready = false;
+  int direct = mockConnect(SOCKET_SERVER_PORT, "direct;", true);
+  run(server, 3);
+  std::string receipt(3000, 'r');
+  int small = mockConnect(SOCKET_SERVER_PORT, receipt);
+  run(server, 5);
+  assert(mockSockets[small].stopped && usb.getJobs().find(2)->state == JOB_PENDING);
+  assert(writesTo("usb1") == 0 && !mockFiles.count("usb1") && !mockFiles.count("usb1OK"));
+  // a bigger one at the same time goes to the flash, and prints after the receipt
+  std::string big(20000, 'b'); for (size_t i = 0; i < big.size(); i++) big[i] = 'a' + i % 26;
+  int large = mockConnect(SOCKET_SERVER_PORT, big);
+  run(server, 60);
+  assert(mockSockets[large].stopped && mockFiles.count("usb2OK"));
+  mockSockets[direct].connected = false;
+  usb.ready = true;
+  run(server, 100);
+  assert(usb.out == "direct;" + receipt + big);
+  for (uint32_t id = 1; id <= 3; id++) assert(usb.getJobs().find(id)->state == JOB_COMPLETED);
+  assert(!mockFiles.count("usb2OK") && usb.getQueuedJobCount() == 0);
+  // a job bigger than the RAM spool spills in aligned blocks, the last one with what's left
+  usb.out.clear(); usb.ready = false;
+  direct = mockConnect(SOCKET_SERVER_PORT, "", true);
+  run(server, 3);
+  large = mockConnect(SOCKET_SERVER_PORT, big);
+  run(server, 60);
+  assert(mockSockets[large].stopped && mockFiles.count("usb3OK"));
+  // one write per block: up to the next boundary, then whole blocks, then what's left at the end
+  std::vector<MockFlashWrite> spills;
+  for (auto& w : mockFlashWrites) if (w.path == "usb3" && w.offset > 0) spills.push_back(w);
+  assert(spills.size() == (big.size() - SPOOL_RAM_SIZE + SPOOL_SPILL_SIZE - 1) / SPOOL_SPILL_SIZE + 1);
+  for (size_t i = 0; i + 1 < spills.size(); i++) assert((spills[i].offset + spills[i].length) % SPOOL_SPILL_SIZE == 0 && spills[i].length <= SPOOL_SPILL_SIZE);
+  assert(spills.back().offset + spills.back().length == big.size() + 3); //after the three-byte header
+  // and the RAM spool is free again for the next one, which a cancel drops
+  int canceled = mockConnect(SOCKET_SERVER_PORT, receipt);
+  run(server, 5);
+  assert(mockSockets[canceled].stopped && !mockFiles.count("usb4") && !mockFiles.count("usb4OK"));
+  assert(usb.cancelJob(6));
+  mockSockets[direct].connected = false;
+  usb.ready = true;
+  run(server, 100);
+  assert(usb.out == big && usb.getJobs().find(6)->state == JOB_CANCELED && usb.getQueuedJobCount() == 0);
+  puts("ok");
+}
@@ -0,0 +1,32 @@
+#include "RequestRouter.h"
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+int main() {
+  RequestRouter r;
+  assert(r.add("GET", "", 0));
+  assert(r.add("GET", "wifi", 2));
+  assert(r.add("POST", "wifi-connect", 3));
+  assert(r.add("GET", "printerInfo", 1));
+  assert(!r.add("GET", "wifi", 9));
+  assert(r.find("GET", "/") == 0);
+  assert(r.find("GET", "/printerInfo") == 1);
+  assert(r.find("GET", "/wifi") == 2);
+  assert(r.find("POST", "/wifi-connect") == 3);
+  assert(r.find("POST", "/wifi") == -1);
+  assert(r.find("GET", "wifi") == -1);
+  assert(r.find("GET", "/wif") == -1);
+  assert(r.find("GET", "/wifi-connect") == -1);
+  // full table, any insertion order
+  RequestRouter p; std::vector<std::string> names;
+  for (int i = 0; i < MAX_ROUTES; i++) names.push_back("printer" + std::to_string((i * 7) % MAX_ROUTES));
+  for (int i = 0; i < MAX_ROUTES; i++) assert(p.add("POST", names[i].c_str(), i));
+  assert(!p.add("POST", "extra", 99));
+  for (int i = 0; i < MAX_ROUTES; i++) assert(p.find("POST", ("/" + names[i]).c_str()) == i);
+  assert(p.find("POST", "/printer") == -1);
+  auto start = std::chrono::steady_clock::now(); int sum = 0;
+  for (int n = 0; n < 1000000; n++) sum += p.find("POST", "/printer13");
+  printf("router: %.0f ns per lookup among %d routes (%d)\n", std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / 1000000, MAX_ROUTES, sum > 0);
+  puts("ok");
+}
@@ -0,0 +1,47 @@
+#include "TcpStream.h"
+#include <assert.h>
+extern std::string mockInput, mockOutput; extern size_t mockPos, mockChunk, mockWriteCalls; extern bool mockConnected;
+// whatever the network's segment size and the reader's block size, block reads and zero-copy
+// reads hand over the whole stream in order
+int main() {
+  std::string data(10000, 0); for (size_t i = 0; i < data.size(); i++) data[i] = (char) (i * 7 + i / 251);
+  for (mockChunk = 1; mockChunk < 5000; mockChunk = mockChunk * 3 + 1) for (size_t piece : {1, 100, 1460, 3000}) for (int zeroCopy = 0; zeroCopy < 2; zeroCopy++) {
+    mockInput = data; mockPos = 0; mockConnected = false;
+    TcpStream s; s.begin(WiFiClient());
+    std::string got; byte buf[3000]; int guard = 0;
+    while (s.hasMoreData() && guard++ < 1000000) {
+      if (zeroCopy) { const byte* d; size_t n = std::min(s.peekData(&d), piece); got.append((const char*) d, n); s.consumeData(n); }
+      else { size_t n = s.readBytes(buf, piece); got.append((char*) buf, n); }
+    }
+    assert(got == data && s.available() == 0);
+    s.close();
+  }
+  // the socket isn't read again once high bytes are buffered, until they're consumed down to low;
+  // without watermarks set, it's read as soon as there's room
+  mockInput = data; mockPos = 0; mockChunk = 5000; mockConnected = true;
+  TcpStream s; s.begin(WiFiClient()); s.setWatermarks(500, 1000);
+  byte buf[1000];
+  assert(s.available() == 1000 && mockPos == 1000);
+  s.readBytes(buf, 499);
+  assert(s.available() == 501 && mockPos == 1000);
+  s.readBytes(buf, 1);
+  assert(s.available() == 1000 && mockPos == 1500);
+  s.close();
+  s.begin(WiFiClient());
+  assert(s.available() == RECEIVE_HIGH_WATERMARK && mockPos == 1500 + RECEIVE_HIGH_WATERMARK);
+  s.readBytes(buf, 1);
+  assert(s.available() == RECEIVE_HIGH_WATERMARK && mockPos == 1501 + RECEIVE_HIGH_WATERMARK);
+  s.close();
+  // with every pool buffer lent out, small spans still leave together: only a big one on its own
+  byte* lent[IO_BUFFER_COUNT]; for (int i = 0; i < IO_BUFFER_COUNT; i++) lent[i] = BufferPool::acquire();
+  assert(BufferPool::acquire() == NULL);
+  std::string big(SEND_STACK_BUFFER_SIZE + 1, 'b');
+  SendSpan spans[] = {{(const byte*) "HTTP/1.1 ", 9, true}, {(const byte*) "200 OK", 6, false}, {(const byte*) "\r\n", 2, true},
+    {(const byte*) big.data(), big.size(), false}, {(const byte*) "a", 1, false}, {(const byte*) "z", 1, false}};
+  s.begin(WiFiClient()); mockOutput.clear(); mockWriteCalls = 0;
+  s.writeSpans(spans, 6);
+  assert(mockOutput == "HTTP/1.1 200 OK\r\n" + big + "az" && mockWriteCalls == 3);
+  s.close();
+  for (int i = 0; i < IO_BUFFER_COUNT; i++) BufferPool::release(lent[i]);
+  puts("ok");
+}
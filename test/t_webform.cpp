@@ -0,0 +1,42 @@
+// the WiFi form's body, read a piece per pass without holding up the loop
+#include "TcpPrintServer.h"
+#include "WiFiManager.h"
+#include "netmock.h"
+#include <cassert>
+extern size_t mockChunk;
+extern String mockWifiSsid, mockWifiPassword;
+struct P: Printer { P(const char* n): Printer(n) {} bool canPrint() { return true; } void printByte(byte) {} String getInfo() {return "";} };
+static std::string form(const std::string& body) {
+  return "POST /wifi-connect HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+int main() {
+  mockChunk = 1460;
+  P usb("usb"); usb.init();
+  Printer* printers[] = {&usb};
+  TcpPrintServer server(printers, 1);
+  server.start();
+  // one byte per millisecond: each pass takes what has arrived and moves on
+  int slow = mockConnect(HTTP_SERVER_PORT, form("SSID=home&password=se%26cret"));
+  mockSockets[slow].trickleUs = 1000;
+  int passes = 0;
+  while (!mockSockets[slow].stopped && passes < 100000) {
+    unsigned long start = micros();
+    server.process();
+    assert(micros() - start < 1000);
+    mockClockOffsetUs += 100;
+    passes++;
+  }
+  assert(mockSockets[slow].output.find("<h1>OK</h1>") != std::string::npos);
+  assert(mockWifiSsid == "home" && mockWifiPassword == "se%26cret");
+  // a body that doesn't fit is dropped with the connection
+  mockWifiSsid = "";
+  int big = mockConnect(HTTP_SERVER_PORT, form("SSID=x&password=" + std::string(WEB_FORM_MAX_LENGTH, 'p')));
+  for (int i = 0; i < 20 && !mockSockets[big].stopped; i++) { server.process(); mockClockOffsetUs += SERVICE_INTERVAL_MS * 1000; }
+  assert(mockSockets[big].stopped && mockSockets[big].output.empty() && mockWifiSsid == "");
+  // fields in any order, and a missing one is empty
+  int other = mockConnect(HTTP_SERVER_PORT, form("password=&SSID=cafe"));
+  for (int i = 0; i < 20 && !mockSockets[other].stopped; i++) { server.process(); mockClockOffsetUs += SERVICE_INTERVAL_MS * 1000; }
+  assert(mockWifiSsid == "cafe" && mockWifiPassword == "");
+  printf("form of %zu bytes read over %d passes\n", mockSockets[slow].input.size(), passes);
+  puts("ok");
+}
@@ -0,0 +1,45 @@
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "WiFiManager.h"
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+extern unsigned long long mockClockOffsetUs;
+static int scansStarted = 0, pollsLeft = 0; static bool running = false;
+void WiFiClass::setAutoConnect(bool) {} void WiFiClass::setAutoReconnect(bool) {}
+bool WiFiClass::isConnected() { return true; } bool WiFiClass::softAP(const char*) { return true; }
+IPAddress WiFiClass::softAPIP() { return IPAddress(); } IPAddress WiFiClass::localIP() { return IPAddress(); }
+int WiFiClass::status() { return WL_CONNECTED; } String WiFiClass::SSID() { return "home"; }
+String WiFiClass::SSID(int i) { return i == 0 ? "a-network-with-a-very-long-name-over-32-chars" : "net" + String(i); }
+int32_t WiFiClass::RSSI() { return -50; } int32_t WiFiClass::RSSI(int i) { return -40 - i; }
+uint8_t WiFiClass::encryptionType(int) { return ENC_TYPE_CCMP; }
+int8_t WiFiClass::scanNetworks(bool async) { assert(async); scansStarted++; running = true; pollsLeft = 3; return WIFI_SCAN_RUNNING; }
+int8_t WiFiClass::scanComplete() { if (!running) return WIFI_SCAN_FAILED; if (pollsLeft-- > 0) return WIFI_SCAN_RUNNING; return 20; }
+void WiFiClass::scanDelete() { running = false; }
+bool WiFiClass::softAPdisconnect(bool) { return true; } int WiFiClass::begin(const char*, const char*) { return 0; }
+
+static int listed() { int n = 0; WiFiManager::getAvailableNetworks([&n](String ssid, int, int) { assert(ssid.length() <= 32); n++; }); return n; }
+
+int main() {
+  // busy at boot: the first scan waits
+  WiFiManager::processScan(true);
+  assert(scansStarted == 0 && listed() == 0);
+  WiFiManager::processScan(false);
+  assert(scansStarted == 1);
+  for (int i = 0; i < 3; i++) { WiFiManager::processScan(false); assert(listed() == 0); }
+  WiFiManager::processScan(false);
+  assert(listed() == WIFI_SCAN_CACHE_SIZE && !running);
+  // fresh cache: the page doesn't ask for another one
+  WiFiManager::refreshNetworks();
+  WiFiManager::processScan(false);
+  assert(scansStarted == 1);
+  mockClockOffsetUs += (WIFI_SCAN_MAX_AGE_MS + 1) * 1000ULL;
+  WiFiManager::refreshNetworks();
+  WiFiManager::processScan(true);
+  assert(scansStarted == 1);
+  printf("%s\n", WiFiManager::scanInfo().c_str());
+  WiFiManager::processScan(false);
+  assert(scansStarted == 2 && listed() == WIFI_SCAN_CACHE_SIZE);
+  printf("ok\n");
+}